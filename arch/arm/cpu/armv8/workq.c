@@ -0,0 +1,173 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Work queue backend for ARMv8, starting secondary CPUs with PSCI
+ *
+ * The CPUs are taken from the /cpus node of the control devicetree. Each one
+ * is started with PSCI CPU_ON and set up with the page tables of the boot CPU
+ * by workq_secondary_start(). Once out of jobs it turns itself off again with
+ * PSCI CPU_OFF.
+ */
+
+#define LOG_CATEGORY	LOGC_ARCH
+
+#include <common.h>
+#include <cpu_func.h>
+#include <dm/ofnode.h>
+#include <log.h>
+#include <malloc.h>
+#include <workq.h>
+#include <asm/cache.h>
+#include <asm/global_data.h>
+#include <asm/system.h>
+#include <linux/psci.h>
+#include <linux/sizes.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+#define WORKQ_STACK_SIZE	SZ_64K
+#define MPIDR_HWID_MASK		0xff00ffffffUL
+
+/*
+ * State handed to a secondary CPU, read with the MMU off. Keep in sync with
+ * workq_entry.S
+ */
+struct workq_boot {
+	u64 ttbr;
+	u64 tcr;
+	u64 mair;
+	u64 sctlr;
+	u64 vbar;
+	u64 sp;
+	u64 gd;
+	u64 cpu;
+} __aligned(ARCH_DMA_MINALIGN);
+
+static struct workq_boot workq_boot[CONFIG_WORKQ_MAX_CPUS];
+static void *workq_stack[CONFIG_WORKQ_MAX_CPUS];
+static u64 workq_mpidr[CONFIG_WORKQ_MAX_CPUS];
+static int workq_ncpus;
+
+void workq_secondary_start(struct workq_boot *boot);
+
+/* Called by workq_secondary_start() */
+void workq_secondary_main(int cpu)
+{
+	workq_secondary(cpu);
+	invoke_psci_fn(PSCI_0_2_FN_CPU_OFF, 0, 0, 0);
+}
+
+static void workq_find_cpus(void)
+{
+	u64 self = read_mpidr() & MPIDR_HWID_MASK;
+	ofnode cpus, node;
+
+	workq_mpidr[0] = self;
+	workq_ncpus = 1;
+
+	cpus = ofnode_path("/cpus");
+	ofnode_for_each_subnode(node, cpus) {
+		const char *type = ofnode_read_string(node, "device_type");
+		const fdt32_t *reg;
+		u64 mpidr;
+		int len;
+
+		if (!type || strcmp(type, "cpu"))
+			continue;
+		reg = ofnode_read_prop(node, "reg", &len);
+		if (!reg || (len != 4 && len != 8))
+			continue;
+		mpidr = len == 8 ? fdt64_to_cpu(*(fdt64_t *)reg) :
+				   fdt32_to_cpu(*reg);
+		if ((mpidr & MPIDR_HWID_MASK) == self)
+			continue;
+		if (workq_ncpus == CONFIG_WORKQ_MAX_CPUS)
+			break;
+		workq_mpidr[workq_ncpus++] = mpidr;
+	}
+	log_debug("%d CPUs\n", workq_ncpus);
+}
+
+int arch_workq_cpus(void)
+{
+	/* Exclusive accesses need the caches, so does keeping coherent */
+	if (!dcache_status())
+		return 1;
+	if (!workq_ncpus)
+		workq_find_cpus();
+
+	return workq_ncpus;
+}
+
+int arch_workq_start(int cpu)
+{
+	struct workq_boot *boot = &workq_boot[cpu];
+	int ret;
+
+	workq_stack[cpu] = memalign(16, WORKQ_STACK_SIZE);
+	if (!workq_stack[cpu])
+		return -ENOMEM;
+
+	switch (current_el()) {
+	case 3:
+		asm volatile("mrs %0, ttbr0_el3" : "=r" (boot->ttbr));
+		asm volatile("mrs %0, tcr_el3" : "=r" (boot->tcr));
+		asm volatile("mrs %0, mair_el3" : "=r" (boot->mair));
+		asm volatile("mrs %0, vbar_el3" : "=r" (boot->vbar));
+		break;
+	case 2:
+		asm volatile("mrs %0, ttbr0_el2" : "=r" (boot->ttbr));
+		asm volatile("mrs %0, tcr_el2" : "=r" (boot->tcr));
+		asm volatile("mrs %0, mair_el2" : "=r" (boot->mair));
+		asm volatile("mrs %0, vbar_el2" : "=r" (boot->vbar));
+		break;
+	default:
+		asm volatile("mrs %0, ttbr0_el1" : "=r" (boot->ttbr));
+		asm volatile("mrs %0, tcr_el1" : "=r" (boot->tcr));
+		asm volatile("mrs %0, mair_el1" : "=r" (boot->mair));
+		asm volatile("mrs %0, vbar_el1" : "=r" (boot->vbar));
+		break;
+	}
+	boot->sctlr = get_sctlr();
+	boot->sp = (ulong)workq_stack[cpu] + WORKQ_STACK_SIZE;
+	boot->gd = (ulong)gd;
+	boot->cpu = cpu;
+
+	/* The CPU reads this with its MMU off */
+	flush_dcache_range((ulong)boot, (ulong)(boot + 1));
+
+	ret = invoke_psci_fn(PSCI_0_2_FN64_CPU_ON, workq_mpidr[cpu],
+			     (ulong)workq_secondary_start, (ulong)boot);
+	if (ret != PSCI_RET_SUCCESS) {
+		free(workq_stack[cpu]);
+		workq_stack[cpu] = NULL;
+		return -EIO;
+	}
+
+	return 0;
+}
+
+int arch_workq_finish(int cpu)
+{
+	/* Wait until the CPU is off, so that it can be started again */
+	while (invoke_psci_fn(PSCI_0_2_FN64_AFFINITY_INFO, workq_mpidr[cpu],
+			      0, 0) != PSCI_0_2_AFFINITY_LEVEL_OFF)
+		;
+
+	free(workq_stack[cpu]);
+	workq_stack[cpu] = NULL;
+
+	return 0;
+}
+
+int arch_workq_cpu(void)
+{
+	u64 self = read_mpidr() & MPIDR_HWID_MASK;
+	int cpu;
+
+	for (cpu = 1; cpu < workq_ncpus; cpu++) {
+		if ((workq_mpidr[cpu] & MPIDR_HWID_MASK) == self)
+			return cpu;
+	}
+
+	return 0;
+}
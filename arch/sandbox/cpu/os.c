@@ -968,6 +968,32 @@ void os_set_time_offset(long offset)
 		       ENV_TIME_OFFSET);
 }
 
+int os_thread_create(void **threadp, void *(*func)(void *), void *arg)
+{
+	pthread_t *thread;
+
+	thread = os_malloc(sizeof(*thread));
+	if (!thread)
+		return -ENOMEM;
+	if (pthread_create(thread, NULL, func, arg)) {
+		os_free(thread);
+		return -EAGAIN;
+	}
+	*threadp = thread;
+
+	return 0;
+}
+
+int os_thread_join(void *thread)
+{
+	int ret;
+
+	ret = pthread_join(*(pthread_t *)thread, NULL);
+	os_free(thread);
+
+	return ret ? -EINVAL : 0;
+}
+
 void os_localtime(struct rtc_time *rt)
 {
 	time_t t = time(NULL);
@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Work queue backend for sandbox, emulating each secondary CPU with a host
+ * thread
+ */
+
+#include <common.h>
+#include <os.h>
+#include <workq.h>
+#include <asm/test.h>
+
+static int workq_cpus = 4;
+static void *workq_threads[CONFIG_WORKQ_MAX_CPUS];
+static __thread int workq_this_cpu;
+
+void sandbox_workq_set_cpus(int cpus)
+{
+	workq_cpus = cpus;
+}
+
+static void *workq_thread(void *arg)
+{
+	int cpu = (long)arg;
+
+	workq_this_cpu = cpu;
+	workq_secondary(cpu);
+
+	return NULL;
+}
+
+int arch_workq_cpus(void)
+{
+	return workq_cpus;
+}
+
+int arch_workq_start(int cpu)
+{
+	return os_thread_create(&workq_threads[cpu], workq_thread,
+				(void *)(long)cpu);
+}
+
+int arch_workq_finish(int cpu)
+{
+	void *thread = workq_threads[cpu];
+
+	workq_threads[cpu] = NULL;
+
+	return os_thread_join(thread);
+}
+
+int arch_workq_cpu(void)
+{
+	return workq_this_cpu;
+}
@@ -357,4 +357,13 @@ bool sandbox_sf_bootdev_enabled(void);
  */
 void sandbox_sf_set_enable_bootdevs(bool enable);
 
+/**
+ * sandbox_workq_set_cpus() - Set the number of CPUs used by the work queue
+ *
+ * Each CPU besides the boot CPU is emulated by a host thread.
+ *
+ * @cpus: Number of CPUs, including the boot CPU
+ */
+void sandbox_workq_set_cpus(int cpus);
+
 #endif
@@ -30,6 +30,7 @@
 #include <dm.h>
 #include <u-boot/hash.h>
 #endif
+#include <workq.h>
 DECLARE_GLOBAL_DATA_PTR;
 #endif /* !USE_HOSTCC*/
 
@@ -1294,6 +1295,174 @@ int calculate_hash(const void *data, int data_len, const char *name,
 	return 0;
 }
 
+#if !defined(USE_HOSTCC) && CONFIG_IS_ENABLED(FIT_PARALLEL_HASH)
+/* Maximum number of hashes computed up front for a configuration */
+#define FIT_PREHASH_MAX		16
+
+/**
+ * struct fit_prehash - a hash of an image computed up front
+ *
+ * @noffset: offset of the hash node
+ * @data: image data which was hashed
+ * @size: size of the image data
+ * @algo: hash algorithm name
+ * @value: hash value
+ * @value_len: length of the hash value, 0 if it could not be computed
+ */
+struct fit_prehash {
+	int noffset;
+	const void *data;
+	size_t size;
+	const char *algo;
+	uint8_t value[FIT_MAX_HASH_LEN];
+	int value_len;
+};
+
+static struct fit_prehash fit_prehash[FIT_PREHASH_MAX];
+static struct workq_job fit_prehash_jobs[FIT_PREHASH_MAX];
+static struct bootm_headers *fit_prehash_images;
+static const void *fit_prehash_fit;
+static int fit_prehash_count;
+
+static int fit_prehash_job(struct workq_job *job)
+{
+	struct fit_prehash *ph = job->priv;
+
+	if (calculate_hash(ph->data, ph->size, ph->algo, ph->value,
+			   &ph->value_len)) {
+		ph->value_len = 0;
+		return -EPROTONOSUPPORT;
+	}
+
+	return 0;
+}
+
+static void fit_prehash_add_image(const void *fit, int image_noffset)
+{
+	const void *data;
+	size_t size;
+	int noffset;
+	int i;
+
+	for (i = 0; i < fit_prehash_count; i++) {
+		if (fdt_parent_offset(fit, fit_prehash[i].noffset) ==
+		    image_noffset)
+			return;
+	}
+
+	if (fit_image_get_data_and_size(fit, image_noffset, &data, &size))
+		return;
+
+	fdt_for_each_subnode(noffset, fit, image_noffset) {
+		const char *name = fit_get_name(fit, noffset, NULL);
+		struct fit_prehash *ph;
+		const char *algo;
+		int ignore;
+
+		if (strncmp(name, FIT_HASH_NODENAME,
+			    strlen(FIT_HASH_NODENAME)))
+			continue;
+		fit_image_hash_get_ignore(fit, noffset, &ignore);
+		if (ignore || fit_image_hash_get_algo(fit, noffset, &algo))
+			continue;
+		if (fit_prehash_count == FIT_PREHASH_MAX)
+			return;
+
+		ph = &fit_prehash[fit_prehash_count];
+		ph->noffset = noffset;
+		ph->data = data;
+		ph->size = size;
+		ph->algo = algo;
+		ph->value_len = 0;
+		fit_prehash_jobs[fit_prehash_count].func = fit_prehash_job;
+		fit_prehash_jobs[fit_prehash_count].priv = ph;
+		fit_prehash_count++;
+	}
+}
+
+/**
+ * fit_config_prehash() - hash all images of a configuration on several CPUs
+ *
+ * The hashes are picked up by fit_image_check_hash() when the images are
+ * verified. Failures are not reported here, the hash is then just computed
+ * again at that point.
+ *
+ * The hashes are only used while @images->fit_prehashed stays set, i.e. until
+ * the next bootm clears @images, so that they cannot outlive the data.
+ *
+ * @images: boot images the configuration is loaded for
+ * @fit: FIT to check
+ * @conf_noffset: offset of the configuration node
+ */
+static void fit_config_prehash(struct bootm_headers *images, const void *fit,
+			       int conf_noffset)
+{
+	int prop;
+
+	if (images->fit_prehashed && fit == fit_prehash_fit)
+		return;
+
+	fit_prehash_images = images;
+	fit_prehash_fit = fit;
+	fit_prehash_count = 0;
+
+	/* Each property naming images, e.g. kernel, fdt or loadables */
+	fdt_for_each_property_offset(prop, fit, conf_noffset) {
+		const char *names;
+		int len, i;
+
+		names = fdt_getprop_by_offset(fit, prop, NULL, &len);
+		for (i = 0; names && i < len; i += strnlen(names + i,
+							     len - i) + 1) {
+			int noffset = fit_image_get_node(fit, names + i);
+
+			if (noffset >= 0)
+				fit_prehash_add_image(fit, noffset);
+		}
+	}
+
+	log_debug("%d hashes on %d CPUs\n", fit_prehash_count,
+		  workq_get_cpus());
+	workq_run(fit_prehash_jobs, fit_prehash_count);
+	images->fit_prehashed = true;
+}
+
+static int fit_image_calc_hash(const void *fit, int noffset, const void *data,
+			       size_t size, const char *algo, uint8_t *value,
+			       int *value_len)
+{
+	int i;
+
+	if (fit_prehash_images && fit_prehash_images->fit_prehashed &&
+	    fit == fit_prehash_fit) {
+		for (i = 0; i < fit_prehash_count; i++) {
+			const struct fit_prehash *ph = &fit_prehash[i];
+
+			if (ph->noffset == noffset && ph->data == data &&
+			    ph->size == size && ph->value_len) {
+				memcpy(value, ph->value, ph->value_len);
+				*value_len = ph->value_len;
+				return 0;
+			}
+		}
+	}
+
+	return calculate_hash(data, size, algo, value, value_len);
+}
+#else
+static inline void fit_config_prehash(struct bootm_headers *images,
+				      const void *fit, int conf_noffset)
+{
+}
+
+static int fit_image_calc_hash(const void *fit, int noffset, const void *data,
+			       size_t size, const char *algo, uint8_t *value,
+			       int *value_len)
+{
+	return calculate_hash(data, size, algo, value, value_len);
+}
+#endif
+
 static int fit_image_check_hash(const void *fit, int noffset, const void *data,
 				size_t size, char **err_msgp)
 {
@@ -1326,7 +1495,8 @@ static int fit_image_check_hash(const void *fit, int noffset, const void *data,
 		return -1;
 	}
 
-	if (calculate_hash(data, size, algo, value, &value_len)) {
+	if (fit_image_calc_hash(fit, noffset, data, size, algo, value,
+				&value_len)) {
 		*err_msgp = "Unsupported hash algorithm";
 		return -1;
 	}
@@ -2127,6 +2297,8 @@ int fit_image_load(struct bootm_headers *images, ulong addr,
 			}
 			puts("OK\n");
 		}
+		if (images->verify)
+			fit_config_prehash(images, fit, cfg_noffset);
 
 		bootstage_mark(BOOTSTAGE_ID_FIT_CONFIG);
 
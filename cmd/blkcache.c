@@ -17,27 +17,38 @@ static int blkc_show(struct cmd_tbl *cmdtp, int flag,
 	blkcache_stats(&stats);
 
 	printf("hits: %u\n"
+	       "partial hits: %u\n"
 	       "misses: %u\n"
+	       "evictions: %u\n"
+	       "read-ahead blocks: %u\n"
 	       "entries: %u\n"
-	       "max blocks/entry: %u\n"
-	       "max cache entries: %u\n",
-	       stats.hits, stats.misses, stats.entries,
-	       stats.max_blocks_per_entry, stats.max_entries);
+	       "memory used: %lu of %lu bytes\n"
+	       "blocks/entry: %u\n"
+	       "max read-ahead blocks: %u\n",
+	       stats.hits, stats.partial_hits, stats.misses, stats.evictions,
+	       stats.readahead, stats.entries, stats.mem_used, stats.max_bytes,
+	       stats.blocks_per_entry, stats.max_readahead);
 	return 0;
 }
 
 static int blkc_configure(struct cmd_tbl *cmdtp, int flag,
 			  int argc, char *const argv[])
 {
-	unsigned blocks_per_entry, max_entries;
-	if (argc != 3)
+	struct block_cache_stats stats;
+	unsigned long max_bytes;
+	unsigned max_readahead;
+
+	if (argc < 2 || argc > 3)
 		return CMD_RET_USAGE;
 
-	blocks_per_entry = simple_strtoul(argv[1], 0, 0);
-	max_entries = simple_strtoul(argv[2], 0, 0);
-	blkcache_configure(blocks_per_entry, max_entries);
-	printf("changed to max of %u entries of %u blocks each\n",
-	       max_entries, blocks_per_entry);
+	blkcache_stats(&stats);
+	max_bytes = simple_strtoul(argv[1], 0, 0);
+	max_readahead = stats.max_readahead;
+	if (argc > 2)
+		max_readahead = simple_strtoul(argv[2], 0, 0);
+	blkcache_configure(max_bytes, max_readahead);
+	printf("changed to %lu bytes with up to %u blocks of read-ahead\n",
+	       max_bytes, max_readahead);
 	return 0;
 }
 
@@ -83,6 +94,6 @@ U_BOOT_CMD(
 	blkcache, 4, 0, do_blkcache,
 	"block cache diagnostics and control",
 	"show - show and reset statistics\n"
-	"blkcache configure <blocks> <entries> "
-	"- set max blocks per entry and max cache entries\n"
+	"blkcache configure <bytes> [<readahead>] "
+	"- set memory budget and max blocks of read-ahead\n"
 );
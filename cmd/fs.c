@@ -6,6 +6,7 @@
  */
 
 #include <common.h>
+#include <blk.h>
 #include <command.h>
 #include <fs.h>
 
@@ -111,3 +112,41 @@ U_BOOT_CMD(
 	fstypes, 1, 1, do_fstypes_wrapper,
 	"List supported filesystem types", ""
 );
+
+#if CONFIG_IS_ENABLED(FS_MOUNT_CACHE)
+static int do_fscache(struct cmd_tbl *cmdtp, int flag, int argc,
+		      char *const argv[])
+{
+	struct fs_mount_stats stats;
+
+	if (argc != 2)
+		return CMD_RET_USAGE;
+
+	if (!strcmp(argv[1], "flush")) {
+		fs_mount_flush();
+		return CMD_RET_SUCCESS;
+	}
+	if (strcmp(argv[1], "show"))
+		return CMD_RET_USAGE;
+
+	fs_mount_get_stats(&stats);
+	if (stats.desc)
+		printf("mounted: %s %d:%d (%s)\n",
+		       blk_get_uclass_name(stats.desc->uclass_id),
+		       stats.desc->devnum, stats.part, stats.name);
+	else
+		printf("mounted: none\n");
+	printf("probes: %u\n"
+	       "probes saved: %u\n",
+	       stats.probes, stats.saved);
+
+	return CMD_RET_SUCCESS;
+}
+
+U_BOOT_CMD(
+	fscache, 2, 1, do_fscache,
+	"filesystem mount cache",
+	"show - show the mounted filesystem and probe counts\n"
+	"fscache flush - close the mounted filesystem\n"
+);
+#endif
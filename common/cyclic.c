@@ -12,6 +12,7 @@
 #include <log.h>
 #include <malloc.h>
 #include <time.h>
+#include <workq.h>
 #include <linux/errno.h>
 #include <linux/list.h>
 #include <asm/global_data.h>
@@ -101,6 +102,10 @@ void cyclic_run(void)
 
 void schedule(void)
 {
+	/* Jobs on secondary CPUs leave this to the boot CPU */
+	if (CONFIG_IS_ENABLED(WORKQ) && workq_cpu())
+		return;
+
 	/* The HW watchdog is not integrated into the cyclic IF (yet) */
 	if (IS_ENABLED(CONFIG_HW_WATCHDOG))
 		hw_watchdog_reset();
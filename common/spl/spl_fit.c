@@ -5,9 +5,11 @@
  */
 
 #include <common.h>
+#include <bootstage.h>
 #include <errno.h>
 #include <fpga.h>
 #include <gzip.h>
+#include <hash.h>
 #include <image.h>
 #include <log.h>
 #include <memalign.h>
@@ -206,6 +208,300 @@ static int get_aligned_image_size(struct spl_load_info *info, int data_size,
 	return (data_size + info->bl_len - 1) / info->bl_len;
 }
 
+#if CONFIG_IS_ENABLED(FIT_STREAM)
+/* Maximum number of hash nodes checked while streaming an image */
+#define SPL_FIT_STREAM_HASHES	4
+
+/**
+ * struct spl_fit_stream_hash - a hash of an image computed while streaming it
+ * @node:	offset of the hash node in the FIT
+ * @algo:	hash algorithm with progressive hashing support
+ * @ctx:	hash context, NULL once finished or freed
+ */
+struct spl_fit_stream_hash {
+	int node;
+	struct hash_algo *algo;
+	void *ctx;
+};
+
+static void spl_fit_stream_free_hashes(struct spl_fit_stream_hash *hashes,
+				       int count)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(uint8_t, value, FIT_MAX_HASH_LEN);
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (hashes[i].ctx)
+			hashes[i].algo->hash_finish(hashes[i].algo,
+						    hashes[i].ctx, value,
+						    FIT_MAX_HASH_LEN);
+		hashes[i].ctx = NULL;
+	}
+}
+
+/**
+ * spl_fit_stream_setup_hashes(): set up the hashes to check for an image
+ * @fit:	points to the FIT blob
+ * @node:	offset of the image node
+ * @hashes:	returns the hashes to compute, SPL_FIT_STREAM_HASHES entries
+ *
+ * This mirrors what fit_image_verify_with_data() checks. Images which need a
+ * signature check over the whole data cannot be streamed.
+ *
+ * Return:	number of hashes set up, -ENOTSUPP if the image must be
+ *		verified the normal way, other negative error number on error
+ */
+static int spl_fit_stream_setup_hashes(const void *fit, int node,
+				       struct spl_fit_stream_hash *hashes)
+{
+	const void *key_blob = gd_fdt_blob();
+	int count = 0;
+	int noffset;
+	int i;
+
+	if (!CONFIG_IS_ENABLED(FIT_SIGNATURE))
+		return 0;
+
+	noffset = fdt_subnode_offset(key_blob, 0, FIT_SIG_NODENAME);
+	if (noffset >= 0) {
+		int key;
+
+		fdt_for_each_subnode(key, key_blob, noffset) {
+			const char *required;
+
+			required = fdt_getprop(key_blob, key, FIT_KEY_REQUIRED,
+					       NULL);
+			if (required && !strcmp(required, "image"))
+				return -ENOTSUPP;
+		}
+	}
+
+	fdt_for_each_subnode(noffset, fit, node) {
+		const char *name = fit_get_name(fit, noffset, NULL);
+		const int *ignore;
+		const char *algo;
+		int len;
+
+		if (!strncmp(name, FIT_SIG_NODENAME, strlen(FIT_SIG_NODENAME)))
+			return -ENOTSUPP;
+		if (strncmp(name, FIT_HASH_NODENAME, strlen(FIT_HASH_NODENAME)))
+			continue;
+
+		ignore = fdt_getprop(fit, noffset, FIT_IGNORE_PROP, &len);
+		if (ignore && len == sizeof(int) && *ignore)
+			continue;
+
+		if (count == SPL_FIT_STREAM_HASHES ||
+		    fit_image_hash_get_algo(fit, noffset, &algo) ||
+		    hash_progressive_lookup_algo(algo, &hashes[count].algo))
+			return -ENOTSUPP;
+		hashes[count].node = noffset;
+		hashes[count].ctx = NULL;
+		count++;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (hashes[i].algo->hash_init(hashes[i].algo,
+					      &hashes[i].ctx)) {
+			hashes[i].ctx = NULL;
+			spl_fit_stream_free_hashes(hashes, i);
+			return -ENOMEM;
+		}
+	}
+
+	return count;
+}
+
+/**
+ * spl_fit_stream_check_hashes(): finish the hashes and compare to the FIT
+ * @fit:	points to the FIT blob
+ * @node:	offset of the image node
+ * @hashes:	hashes computed over the image data
+ * @count:	number of hashes
+ *
+ * Return:	0 if all hashes match, -EPERM otherwise
+ */
+static int spl_fit_stream_check_hashes(const void *fit, int node,
+				       struct spl_fit_stream_hash *hashes,
+				       int count)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(uint8_t, value, FIT_MAX_HASH_LEN);
+	struct spl_fit_stream_hash *hash;
+	uint8_t *fit_value;
+	int fit_value_len;
+	char *err_msg;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		hash = &hashes[i];
+		printf("%s", hash->algo->name);
+		if (hash->algo->hash_finish(hash->algo, hash->ctx, value,
+					    FIT_MAX_HASH_LEN)) {
+			hash->ctx = NULL;
+			err_msg = "Can't finish hash";
+			goto error;
+		}
+		hash->ctx = NULL;
+
+		if (fit_image_hash_get_value(fit, hash->node, &fit_value,
+					     &fit_value_len)) {
+			err_msg = "Can't get hash value property";
+			goto error;
+		}
+		if (fit_value_len != hash->algo->digest_size) {
+			err_msg = "Bad hash value len";
+			goto error;
+		}
+		if (memcmp(value, fit_value, fit_value_len)) {
+			err_msg = "Bad hash value";
+			goto error;
+		}
+		puts("+ ");
+	}
+	puts("OK\n");
+
+	return 0;
+
+error:
+	printf(" error!\n%s for '%s' hash node in '%s' image node\n",
+	       err_msg, fit_get_name(fit, hash->node, NULL),
+	       fit_get_name(fit, node, NULL));
+	spl_fit_stream_free_hashes(hashes, count);
+
+	return -EPERM;
+}
+
+/**
+ * spl_fit_stream_image(): load external image data in chunks
+ * @info:	points to information about the device to load data from
+ * @sector:	the start sector of the FIT image on the device
+ * @fit:	points to the FIT blob
+ * @node:	offset of the image node
+ * @offset:	offset of the image data from the start of the FIT
+ * @length:	size of the image data
+ * @load_addr:	address to load the image to
+ * @gzip:	true to uncompress the image data
+ * @sizep:	returns the size of the loaded image
+ *
+ * Each chunk read from the device is hashed right away and, for compressed
+ * images, uncompressed straight to @load_addr, instead of reading the whole
+ * image first and going over it again for each step. Time spent reading,
+ * hashing and uncompressing is accumulated in bootstage records.
+ *
+ * Return:	0 on success, -ENOTSUPP if the image must be loaded the normal
+ *		way, other negative error number on error
+ */
+static int spl_fit_stream_image(struct spl_load_info *info, ulong sector,
+				const void *fit, int node, int offset,
+				size_t length, ulong load_addr, bool gzip,
+				ulong *sizep)
+{
+	struct spl_fit_stream_hash hashes[SPL_FIT_STREAM_HASHES];
+	ulong unit = info->filename ? 1 : info->bl_len;
+	ulong chunk = max(CONFIG_SPL_FIT_STREAM_CHUNK / unit, 1UL);
+	ulong overhead = get_aligned_image_overhead(info, offset);
+	ulong total = get_aligned_image_size(info, length, offset);
+	ulong first = sector + get_aligned_image_offset(info, offset);
+	struct gunzip_stream gs;
+	ulong done, count, used = 0;
+	void *buf = NULL, *dst;
+	int nhashes, i, ret = 0;
+
+	nhashes = spl_fit_stream_setup_hashes(fit, node, hashes);
+	if (nhashes < 0)
+		return nhashes;
+
+	if (CONFIG_IS_ENABLED(FIT_SIGNATURE))
+		printf("## Checking hash(es) for Image %s ... ",
+		       fit_get_name(fit, node, NULL));
+
+	dst = map_sysmem(ALIGN(load_addr, ARCH_DMA_MINALIGN), length);
+	if (gzip) {
+		buf = malloc_cache_aligned(chunk * unit);
+		if (!buf) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		ret = gunzip_stream_init(&gs, map_sysmem(load_addr,
+							 CONFIG_SYS_BOOTM_LEN),
+					 CONFIG_SYS_BOOTM_LEN);
+		if (ret)
+			goto out;
+	}
+
+	for (done = 0; done < total; done += count) {
+		ulong start = done ? 0 : overhead;
+		ulong bytes;
+		void *data;
+
+		count = min(total - done, chunk);
+		data = gzip ? buf : dst + done * unit;
+
+		bootstage_start(BOOTSTAGE_ID_ACCUM_SPL_FIT_READ, "spl_fit_read");
+		if (info->read(info, first + done, count, data) != count)
+			ret = -EIO;
+		bootstage_accum(BOOTSTAGE_ID_ACCUM_SPL_FIT_READ);
+		if (ret)
+			break;
+
+		data += start;
+		bytes = min(count * unit - start, length - used);
+		used += bytes;
+
+		bootstage_start(BOOTSTAGE_ID_ACCUM_SPL_FIT_HASH, "spl_fit_hash");
+		for (i = 0; i < nhashes && !ret; i++) {
+			struct spl_fit_stream_hash *hash = &hashes[i];
+
+			if (hash->algo->hash_update(hash->algo, hash->ctx,
+						    data, bytes,
+						    used == length)) {
+				/* the context is freed on error */
+				hash->ctx = NULL;
+				ret = -EIO;
+			}
+		}
+		bootstage_accum(BOOTSTAGE_ID_ACCUM_SPL_FIT_HASH);
+		if (ret)
+			break;
+
+		if (gzip) {
+			bootstage_start(BOOTSTAGE_ID_ACCUM_DECOMP, "decomp");
+			ret = gunzip_stream_feed(&gs, data, bytes);
+			bootstage_accum(BOOTSTAGE_ID_ACCUM_DECOMP);
+			if (ret)
+				break;
+		}
+	}
+
+	if (gzip) {
+		int err = gunzip_stream_finish(&gs, sizep);
+
+		if (!ret && err) {
+			puts("Uncompressing error\n");
+			ret = err;
+		}
+	} else {
+		void *load_ptr = map_sysmem(load_addr, length);
+
+		if (!ret && load_ptr != dst + overhead)
+			memmove(load_ptr, dst + overhead, length);
+		*sizep = length;
+	}
+	if (ret)
+		goto out;
+
+	free(buf);
+
+	return spl_fit_stream_check_hashes(fit, node, hashes, nhashes);
+
+out:
+	spl_fit_stream_free_hashes(hashes, nhashes);
+	free(buf);
+
+	return ret;
+}
+#endif
+
 /**
  * spl_load_fit_image(): load the image described in a certain FIT node
  * @info:	points to information about the device to load data from
@@ -281,6 +577,24 @@ static int spl_load_fit_image(struct spl_load_info *info, ulong sector,
 			return 0;
 		}
 
+#if CONFIG_IS_ENABLED(FIT_STREAM)
+		if (!CONFIG_IS_ENABLED(FIT_IMAGE_POST_PROCESS)) {
+			int ret;
+
+			ret = spl_fit_stream_image(info, sector, fit, node,
+						   offset, len, load_addr,
+						   IS_ENABLED(CONFIG_SPL_GZIP) &&
+						   image_comp == IH_COMP_GZIP,
+						   &size);
+			if (!ret) {
+				length = size;
+				goto done;
+			}
+			if (ret != -ENOTSUPP)
+				return ret;
+		}
+#endif
+
 		src_ptr = map_sysmem(ALIGN(load_addr, ARCH_DMA_MINALIGN), len);
 		length = len;
 
@@ -330,6 +644,9 @@ static int spl_load_fit_image(struct spl_load_info *info, ulong sector,
 		memcpy(load_ptr, src, length);
 	}
 
+#if CONFIG_IS_ENABLED(FIT_STREAM)
+done:
+#endif
 	if (image_info) {
 		ulong entry_point;
 
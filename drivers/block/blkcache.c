@@ -11,27 +11,60 @@
 #include <part.h>
 #include <asm/global_data.h>
 #include <linux/ctype.h>
+#include <linux/err.h>
 #include <linux/list.h>
 
 #ifdef CONFIG_NEEDS_MANUAL_RELOC
 DECLARE_GLOBAL_DATA_PTR;
 #endif
 
+/*
+ * The cache is made of entries which each hold an aligned run of
+ * BLKCACHE_ENTRY_BLOCKS blocks of one device. Entries are found through a
+ * hash of (device, first block) and are kept on an LRU list which is used
+ * to evict entries once the byte budget is exhausted. Not every block in an
+ * entry needs to be present, the @valid bitmap tracks which ones are.
+ */
+#define BLKCACHE_ENTRY_BLOCKS	8
+#define BLKCACHE_HASH_BITS	8
+#define BLKCACHE_HASH_SIZE	(1 << BLKCACHE_HASH_BITS)
+#define BLKCACHE_STREAMS	4
+
 struct block_cache_node {
 	struct list_head lh;
+	struct hlist_node hash;
 	int iftype;
 	int devnum;
 	lbaint_t start;
-	lbaint_t blkcnt;
 	unsigned long blksz;
-	char *cache;
+	uint valid;
+	char cache[];
+};
+
+/**
+ * struct blkcache_stream - state of a sequential reader
+ *
+ * @iftype: uclass_id_x for type of device
+ * @devnum: device index of particular type
+ * @next: block expected by the next sequential read
+ * @window: current read-ahead window in blocks, 0 if not yet sequential
+ */
+struct blkcache_stream {
+	int iftype;
+	int devnum;
+	lbaint_t next;
+	uint window;
 };
 
 static LIST_HEAD(block_cache);
+static struct hlist_head block_cache_hash[BLKCACHE_HASH_SIZE];
+static struct blkcache_stream streams[BLKCACHE_STREAMS];
+static uint stream_victim;
 
 static struct block_cache_stats _stats = {
-	.max_blocks_per_entry = 8,
-	.max_entries = 32
+	.blocks_per_entry = BLKCACHE_ENTRY_BLOCKS,
+	.max_bytes = CONFIG_BLOCK_CACHE_SIZE,
+	.max_readahead = CONFIG_BLOCK_CACHE_READAHEAD,
 };
 
 #ifdef CONFIG_NEEDS_MANUAL_RELOC
@@ -46,18 +79,35 @@ int blkcache_init(void)
 }
 #endif
 
+static inline lbaint_t entry_start(lbaint_t blk)
+{
+	return blk & ~(lbaint_t)(BLKCACHE_ENTRY_BLOCKS - 1);
+}
+
+static inline unsigned long entry_bytes(unsigned long blksz)
+{
+	return sizeof(struct block_cache_node) + blksz * BLKCACHE_ENTRY_BLOCKS;
+}
+
+static struct hlist_head *cache_bucket(int iftype, int devnum, lbaint_t start)
+{
+	u64 key;
+
+	key = (u64)start / BLKCACHE_ENTRY_BLOCKS;
+	key ^= (u64)iftype << 56 ^ (u64)devnum << 48;
+	key *= 0x9e3779b97f4a7c15ULL;
+
+	return &block_cache_hash[key >> (64 - BLKCACHE_HASH_BITS)];
+}
+
 static struct block_cache_node *cache_find(int iftype, int devnum,
-					   lbaint_t start, lbaint_t blkcnt,
-					   unsigned long blksz)
+					   lbaint_t start, unsigned long blksz)
 {
 	struct block_cache_node *node;
 
-	list_for_each_entry(node, &block_cache, lh)
-		if ((node->iftype == iftype) &&
-		    (node->devnum == devnum) &&
-		    (node->blksz == blksz) &&
-		    (node->start <= start) &&
-		    (node->start + node->blkcnt >= start + blkcnt)) {
+	hlist_for_each_entry(node, cache_bucket(iftype, devnum, start), hash)
+		if (node->start == start && node->devnum == devnum &&
+		    node->iftype == iftype && node->blksz == blksz) {
 			if (block_cache.next != &node->lh) {
 				/* maintain MRU ordering */
 				list_del(&node->lh);
@@ -65,18 +115,254 @@ static struct block_cache_node *cache_find(int iftype, int devnum,
 			}
 			return node;
 		}
+
+	return NULL;
+}
+
+static void cache_drop(struct block_cache_node *node)
+{
+	debug("drop: start " LBAF "\n", node->start);
+	list_del(&node->lh);
+	hlist_del(&node->hash);
+	_stats.mem_used -= entry_bytes(node->blksz);
+	_stats.entries--;
+	free(node);
+}
+
+static struct block_cache_node *cache_alloc(int iftype, int devnum,
+					    lbaint_t start,
+					    unsigned long blksz)
+{
+	unsigned long bytes = entry_bytes(blksz);
+	struct block_cache_node *node;
+
+	if (bytes > _stats.max_bytes)
+		return NULL;
+
+	/* pop LRU entries until the new one fits */
+	while (_stats.mem_used + bytes > _stats.max_bytes) {
+		cache_drop(list_last_entry(&block_cache,
+					   struct block_cache_node, lh));
+		_stats.evictions++;
+	}
+
+	node = malloc(bytes);
+	if (!node)
+		return NULL;
+
+	node->iftype = iftype;
+	node->devnum = devnum;
+	node->start = start;
+	node->blksz = blksz;
+	node->valid = 0;
+	list_add(&node->lh, &block_cache);
+	hlist_add_head(&node->hash, cache_bucket(iftype, devnum, start));
+	_stats.mem_used += bytes;
+	_stats.entries++;
+
+	return node;
+}
+
+/**
+ * cache_block() - look up a single block in the cache
+ *
+ * @iftype: uclass_id_x for type of device
+ * @devnum: device index of particular type
+ * @blk: block number
+ * @blksz: size in bytes of each block
+ * @nodep: entry checked by the previous call, updated to the entry for @blk
+ * Return: pointer to the cached data, or NULL if @blk is not cached
+ */
+static const char *cache_block(int iftype, int devnum, lbaint_t blk,
+			       unsigned long blksz,
+			       struct block_cache_node **nodep)
+{
+	struct block_cache_node *node = *nodep;
+	lbaint_t start = entry_start(blk);
+	uint idx = blk - start;
+
+	if (!node || node->start != start) {
+		node = cache_find(iftype, devnum, start, blksz);
+		*nodep = node;
+	}
+	if (!node || !(node->valid & BIT(idx)))
+		return NULL;
+
+	return node->cache + idx * blksz;
+}
+
+/* Copy the cached blocks at the start of the range, return how many */
+static lbaint_t cache_copy_head(int iftype, int devnum, lbaint_t start,
+				lbaint_t blkcnt, unsigned long blksz,
+				char *buffer)
+{
+	struct block_cache_node *node = NULL;
+	const char *src;
+	lbaint_t i;
+
+	for (i = 0; i < blkcnt; i++) {
+		src = cache_block(iftype, devnum, start + i, blksz, &node);
+		if (!src)
+			break;
+		memcpy(buffer + i * blksz, src, blksz);
+	}
+
+	return i;
+}
+
+/* Copy the cached blocks at the end of the range, return how many */
+static lbaint_t cache_copy_tail(int iftype, int devnum, lbaint_t start,
+				lbaint_t blkcnt, unsigned long blksz,
+				char *buffer)
+{
+	struct block_cache_node *node = NULL;
+	const char *src;
+	lbaint_t i;
+
+	for (i = blkcnt; i > 0; i--) {
+		src = cache_block(iftype, devnum, start + i - 1, blksz, &node);
+		if (!src)
+			break;
+		memcpy(buffer + (i - 1) * blksz, src, blksz);
+	}
+
+	return blkcnt - i;
+}
+
+static void cache_fill(int iftype, int devnum, lbaint_t start,
+		       lbaint_t blkcnt, unsigned long blksz,
+		       const char *buffer)
+{
+	struct block_cache_node *node;
+	lbaint_t blk, end = start + blkcnt;
+	uint idx, count;
+
+	/* don't let one big read flush everything else */
+	if (blkcnt * blksz > _stats.max_bytes / 4)
+		return;
+
+	debug("fill: start " LBAF ", count " LBAFU "\n", start, blkcnt);
+	for (blk = start; blk < end; blk += count) {
+		node = cache_find(iftype, devnum, entry_start(blk), blksz);
+		if (!node)
+			node = cache_alloc(iftype, devnum, entry_start(blk),
+					   blksz);
+		if (!node)
+			return;
+
+		idx = blk - node->start;
+		count = min_t(lbaint_t, BLKCACHE_ENTRY_BLOCKS - idx, end - blk);
+		memcpy(node->cache + idx * blksz, buffer, count * blksz);
+		node->valid |= GENMASK(idx + count - 1, idx);
+		buffer += count * blksz;
+	}
+}
+
+/**
+ * stream_update() - track sequential access and size the read-ahead window
+ *
+ * @iftype: uclass_id_x for type of device
+ * @devnum: device index of particular type
+ * @start: first block being read
+ * @blkcnt: number of blocks being read
+ * Return: number of blocks to read ahead of @start + @blkcnt, 0 for none
+ */
+static uint stream_update(int iftype, int devnum, lbaint_t start,
+			  lbaint_t blkcnt)
+{
+	struct blkcache_stream *stream;
+	int i;
+
+	for (i = 0; i < BLKCACHE_STREAMS; i++) {
+		stream = &streams[i];
+		if (stream->iftype == iftype && stream->devnum == devnum &&
+		    stream->next == start) {
+			stream->next = start + blkcnt;
+			if (!stream->window)
+				stream->window = BLKCACHE_ENTRY_BLOCKS;
+			else
+				stream->window = min(stream->window * 2,
+						     _stats.max_readahead);
+			return min(stream->window, _stats.max_readahead);
+		}
+	}
+
+	/* not sequential: start tracking a new stream */
+	stream = &streams[stream_victim++ % BLKCACHE_STREAMS];
+	stream->iftype = iftype;
+	stream->devnum = devnum;
+	stream->next = start + blkcnt;
+	stream->window = 0;
+
 	return 0;
 }
 
+ulong blkcache_read_through(struct blk_desc *desc, blkcache_read_op read,
+			    struct udevice *dev, lbaint_t start,
+			    lbaint_t blkcnt, void *buffer)
+{
+	int iftype = desc->uclass_id, devnum = desc->devnum;
+	unsigned long blksz = desc->blksz;
+	lbaint_t head, tail, gap, ra;
+	char *out, *bounce;
+	ulong n;
+
+	if (!_stats.max_bytes || !blkcnt)
+		return read(dev, start, blkcnt, buffer);
+
+	ra = stream_update(iftype, devnum, start, blkcnt);
+	head = cache_copy_head(iftype, devnum, start, blkcnt, blksz, buffer);
+	if (head == blkcnt) {
+		debug("hit: start " LBAF ", count " LBAFU "\n", start, blkcnt);
+		_stats.hits++;
+		return blkcnt;
+	}
+
+	tail = cache_copy_tail(iftype, devnum, start + head, blkcnt - head,
+			       blksz, (char *)buffer + head * blksz);
+	if (head || tail)
+		_stats.partial_hits++;
+	else
+		_stats.misses++;
+
+	start += head;
+	gap = blkcnt - head - tail;
+	out = (char *)buffer + head * blksz;
+	debug("miss: start " LBAF ", count " LBAFU "\n", start, gap);
+
+	/* only small sequential reads benefit from reading ahead */
+	if (tail || gap >= _stats.max_readahead)
+		ra = 0;
+	if (desc->lba && start + gap + ra > desc->lba)
+		ra = desc->lba > start + gap ? desc->lba - start - gap : 0;
+	bounce = ra ? malloc((gap + ra) * blksz) : NULL;
+	if (bounce) {
+		n = read(dev, start, gap + ra, bounce);
+		if (n == gap + ra) {
+			memcpy(out, bounce, gap * blksz);
+			cache_fill(iftype, devnum, start, gap + ra, blksz,
+				   bounce);
+			free(bounce);
+			_stats.readahead += ra;
+			return blkcnt;
+		}
+		free(bounce);
+	}
+
+	n = read(dev, start, gap, out);
+	if (n != gap)
+		return IS_ERR_VALUE(n) ? n : head + n;
+	cache_fill(iftype, devnum, start, gap, blksz, out);
+
+	return blkcnt;
+}
+
 int blkcache_read(int iftype, int devnum,
 		  lbaint_t start, lbaint_t blkcnt,
 		  unsigned long blksz, void *buffer)
 {
-	struct block_cache_node *node = cache_find(iftype, devnum, start,
-						   blkcnt, blksz);
-	if (node) {
-		const char *src = node->cache + (start - node->start) * blksz;
-		memcpy(buffer, src, blksz * blkcnt);
+	if (cache_copy_head(iftype, devnum, start, blkcnt, blksz,
+			    buffer) == blkcnt) {
 		debug("hit: start " LBAF ", count " LBAFU "\n",
 		      start, blkcnt);
 		++_stats.hits;
@@ -93,85 +379,41 @@ void blkcache_fill(int iftype, int devnum,
 		   lbaint_t start, lbaint_t blkcnt,
 		   unsigned long blksz, void const *buffer)
 {
-	lbaint_t bytes;
-	struct block_cache_node *node;
-
-	/* don't cache big stuff */
-	if (blkcnt > _stats.max_blocks_per_entry)
-		return;
-
-	if (_stats.max_entries == 0)
-		return;
-
-	bytes = blksz * blkcnt;
-	if (_stats.max_entries <= _stats.entries) {
-		/* pop LRU */
-		node = (struct block_cache_node *)block_cache.prev;
-		list_del(&node->lh);
-		_stats.entries--;
-		debug("drop: start " LBAF ", count " LBAFU "\n",
-		      node->start, node->blkcnt);
-		if (node->blkcnt * node->blksz < bytes) {
-			free(node->cache);
-			node->cache = 0;
-		}
-	} else {
-		node = malloc(sizeof(*node));
-		if (!node)
-			return;
-		node->cache = 0;
-	}
-
-	if (!node->cache) {
-		node->cache = malloc(bytes);
-		if (!node->cache) {
-			free(node);
-			return;
-		}
-	}
-
-	debug("fill: start " LBAF ", count " LBAFU "\n",
-	      start, blkcnt);
-
-	node->iftype = iftype;
-	node->devnum = devnum;
-	node->start = start;
-	node->blkcnt = blkcnt;
-	node->blksz = blksz;
-	memcpy(node->cache, buffer, bytes);
-	list_add(&node->lh, &block_cache);
-	_stats.entries++;
+	cache_fill(iftype, devnum, start, blkcnt, blksz, buffer);
 }
 
 void blkcache_invalidate(int iftype, int devnum)
 {
-	struct list_head *entry, *n;
-	struct block_cache_node *node;
+	struct block_cache_node *node, *n;
+	int i;
 
-	list_for_each_safe(entry, n, &block_cache) {
-		node = (struct block_cache_node *)entry;
+	list_for_each_entry_safe(node, n, &block_cache, lh) {
 		if (iftype == -1 ||
-		    (node->iftype == iftype && node->devnum == devnum)) {
-			list_del(entry);
-			free(node->cache);
-			free(node);
-			--_stats.entries;
-		}
+		    (node->iftype == iftype && node->devnum == devnum))
+			cache_drop(node);
+	}
+
+	for (i = 0; i < BLKCACHE_STREAMS; i++) {
+		if (iftype == -1 || (streams[i].iftype == iftype &&
+				     streams[i].devnum == devnum))
+			memset(&streams[i], '\0', sizeof(streams[i]));
 	}
 }
 
-void blkcache_configure(unsigned blocks, unsigned entries)
+void blkcache_configure(unsigned long max_bytes, unsigned int max_readahead)
 {
 	/* invalidate cache if there is a change */
-	if ((blocks != _stats.max_blocks_per_entry) ||
-	    (entries != _stats.max_entries))
+	if (max_bytes != _stats.max_bytes)
 		blkcache_invalidate(-1, 0);
 
-	_stats.max_blocks_per_entry = blocks;
-	_stats.max_entries = entries;
+	_stats.max_bytes = max_bytes;
+	_stats.max_readahead = max_readahead;
 
 	_stats.hits = 0;
 	_stats.misses = 0;
+	_stats.partial_hits = 0;
+	_stats.evictions = 0;
+	_stats.readahead = 0;
 }
 
 void blkcache_stats(struct block_cache_stats *stats)
@@ -179,6 +421,9 @@ void blkcache_stats(struct block_cache_stats *stats)
 	memcpy(stats, &_stats, sizeof(*stats));
 	_stats.hits = 0;
 	_stats.misses = 0;
+	_stats.partial_hits = 0;
+	_stats.evictions = 0;
+	_stats.readahead = 0;
 }
 
 void blkcache_free(void)
@@ -12,6 +12,7 @@
 #include <log.h>
 #include <mmc.h>
 #include <dm.h>
+#include <fs.h>
 #include <dm/device-internal.h>
 #include <dm/device_compat.h>
 #include <dm/lists.h>
@@ -471,8 +472,10 @@ static int mmc_select_hwpart(struct udevice *bdev, int hwpart)
 		return -EMEDIUMTYPE;
 
 	ret = mmc_switch_part(mmc, hwpart);
-	if (!ret)
+	if (!ret) {
 		blkcache_invalidate(desc->uclass_id, desc->devnum);
+		fs_mount_invalidate(desc);
+	}
 
 	return ret;
 }
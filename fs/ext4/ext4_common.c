@@ -1647,6 +1647,184 @@ int ext4fs_read_inode(struct ext2_data *data, int ino, struct ext2_inode *inode)
 	return 1;
 }
 
+/* Extent map of the most recently read file, see ext4fs_get_extent_map() */
+static struct ext4_extent_map ext4fs_extent_map = { .ino = -1 };
+
+static int ext4fs_extent_map_add(struct ext4_extent_map *map, lbaint_t lblk,
+				 uint64_t pblk, uint32_t len)
+{
+	struct ext4_extent_run *run;
+
+	if (map->count) {
+		run = &map->runs[map->count - 1];
+		if (lblk < run->lblk + run->len)
+			return -EINVAL;
+		/* merge with the previous run if it continues it on disk */
+		if (run->lblk + run->len == lblk &&
+		    ((!pblk && !run->pblk) ||
+		     (pblk && run->pblk && run->pblk + run->len == pblk))) {
+			run->len += len;
+			return 0;
+		}
+	}
+
+	if (map->count == map->alloc) {
+		int alloc = map->alloc ? map->alloc * 2 : 16;
+
+		run = realloc(map->runs, alloc * sizeof(*run));
+		if (!run)
+			return -ENOMEM;
+		map->runs = run;
+		map->alloc = alloc;
+	}
+	run = &map->runs[map->count++];
+	run->lblk = lblk;
+	run->pblk = pblk;
+	run->len = len;
+
+	return 0;
+}
+
+static int ext4fs_extent_map_walk(struct ext4_extent_map *map,
+				  struct ext4_extent_header *ext_block,
+				  int depth)
+{
+	int log2_blksz = LOG2_BLOCK_SIZE(ext4fs_root) -
+		get_fs()->dev_desc->log2blksz;
+	int blksz = EXT2_BLOCK_SIZE(ext4fs_root);
+	struct ext4_extent_idx *index;
+	struct ext4_extent *extent;
+	unsigned long long block;
+	uint32_t len;
+	char *buf;
+	int i, ret;
+
+	if (le16_to_cpu(ext_block->eh_magic) != EXT4_EXT_MAGIC ||
+	    le16_to_cpu(ext_block->eh_entries) >
+	    le16_to_cpu(ext_block->eh_max) ||
+	    le16_to_cpu(ext_block->eh_depth) != depth)
+		return -EINVAL;
+
+	if (!depth) {
+		extent = (struct ext4_extent *)(ext_block + 1);
+		for (i = 0; i < le16_to_cpu(ext_block->eh_entries); i++) {
+			len = le16_to_cpu(extent[i].ee_len);
+			block = le16_to_cpu(extent[i].ee_start_hi);
+			block = (block << 32) +
+				le32_to_cpu(extent[i].ee_start_lo);
+			/* unwritten extents read as zeroes */
+			if (len > EXT4_EXT_INIT_MAX_LEN) {
+				len -= EXT4_EXT_INIT_MAX_LEN;
+				block = 0;
+			}
+			ret = ext4fs_extent_map_add(map,
+					le32_to_cpu(extent[i].ee_block),
+					block, len);
+			if (ret)
+				return ret;
+		}
+		return 0;
+	}
+
+	buf = memalign(ARCH_DMA_MINALIGN, blksz);
+	if (!buf)
+		return -ENOMEM;
+
+	index = (struct ext4_extent_idx *)(ext_block + 1);
+	for (i = 0; i < le16_to_cpu(ext_block->eh_entries); i++) {
+		block = le16_to_cpu(index[i].ei_leaf_hi);
+		block = (block << 32) + le32_to_cpu(index[i].ei_leaf_lo);
+		if (!ext4fs_devread((lbaint_t)block << log2_blksz, 0, blksz,
+				    buf)) {
+			ret = -EIO;
+			break;
+		}
+		ret = ext4fs_extent_map_walk(map,
+					     (struct ext4_extent_header *)buf,
+					     depth - 1);
+		if (ret)
+			break;
+	}
+	free(buf);
+
+	return ret;
+}
+
+/**
+ * ext4fs_get_extent_map() - get the decoded extent tree of a file
+ *
+ * The whole tree is read once and turned into a sorted list of runs, so that
+ * a file can be read with one device read per run rather than one tree walk
+ * per block. The map of the last file is kept until the filesystem is closed
+ * or written.
+ *
+ * @node: node of a file which uses extents
+ * Return: extent map, or NULL if the tree cannot be read
+ */
+struct ext4_extent_map *ext4fs_get_extent_map(struct ext2fs_node *node)
+{
+	struct ext4_extent_map *map = &ext4fs_extent_map;
+	struct ext4_extent_header *root;
+	int depth, ret;
+
+	if (map->ino == node->ino &&
+	    !memcmp(map->i_block, &node->inode.b, sizeof(map->i_block)))
+		return map;
+
+	map->ino = -1;
+	map->count = 0;
+	root = (struct ext4_extent_header *)node->inode.b.blocks.dir_blocks;
+	depth = le16_to_cpu(root->eh_depth);
+	if (depth > EXT4_EXT_MAX_DEPTH)
+		return NULL;
+	ret = ext4fs_extent_map_walk(map, root, depth);
+	if (ret) {
+		log_debug("cannot map extents of inode %d (err=%d)\n",
+			  node->ino, ret);
+		return NULL;
+	}
+	map->ino = node->ino;
+	memcpy(map->i_block, &node->inode.b, sizeof(map->i_block));
+
+	return map;
+}
+
+/**
+ * ext4fs_extent_map_find() - find the first run which ends after a block
+ *
+ * @map: extent map to search
+ * @fileblock: logical block number
+ * Return: index of the run containing @fileblock or, if it is in a hole, of
+ * the next run; @map->count if there is none
+ */
+int ext4fs_extent_map_find(struct ext4_extent_map *map, lbaint_t fileblock)
+{
+	int lo = 0, hi = map->count;
+
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		struct ext4_extent_run *run = &map->runs[mid];
+
+		if (run->lblk + run->len <= fileblock)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+void ext4fs_free_extent_map(void)
+{
+	struct ext4_extent_map *map = &ext4fs_extent_map;
+
+	free(map->runs);
+	map->runs = NULL;
+	map->count = 0;
+	map->alloc = 0;
+	map->ino = -1;
+}
+
 long int read_allocated_block(struct ext2_inode *inode, int fileblock,
 			      struct ext_block_cache *cache)
 {
@@ -2014,6 +2192,7 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock,
  */
 void ext4fs_reinit_global(void)
 {
+	ext4fs_free_extent_map();
 	if (ext4fs_indir1_block != NULL) {
 		free(ext4fs_indir1_block);
 		ext4fs_indir1_block = NULL;
@@ -2346,7 +2525,11 @@ int ext4fs_open(const char *filename, loff_t *len)
 	if (ext4fs_root == NULL)
 		return -1;
 
-	ext4fs_file = NULL;
+	/* The filesystem may stay mounted between files, see fs_close() */
+	if (ext4fs_file) {
+		ext4fs_free_node(ext4fs_file, &ext4fs_root->diropen);
+		ext4fs_file = NULL;
+	}
 	status = ext4fs_find_file(filename, &ext4fs_root->diropen, &fdiro,
 				  FILETYPE_REG);
 	if (status == 0)
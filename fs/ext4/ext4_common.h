@@ -48,8 +48,41 @@ static inline void *zalloc(size_t size)
 	return p;
 }
 
+/**
+ * struct ext4_extent_run - a run of file blocks taken from the extent tree
+ *
+ * @lblk: first logical (file) block of the run
+ * @pblk: first physical block of the run, or 0 if it reads as zeroes
+ * @len: number of blocks in the run
+ */
+struct ext4_extent_run {
+	lbaint_t lblk;
+	uint64_t pblk;
+	uint32_t len;
+};
+
+/**
+ * struct ext4_extent_map - decoded extent tree of one inode
+ *
+ * @ino: inode number the map belongs to
+ * @i_block: copy of the root of the tree, used to check the map is current
+ * @runs: runs sorted by logical block, with adjacent extents merged
+ * @count: number of valid entries in @runs
+ * @alloc: number of entries allocated in @runs
+ */
+struct ext4_extent_map {
+	int ino;
+	char i_block[sizeof(((struct ext2_inode *)0)->b)];
+	struct ext4_extent_run *runs;
+	int count;
+	int alloc;
+};
+
 int ext4fs_read_inode(struct ext2_data *data, int ino,
 		      struct ext2_inode *inode);
+struct ext4_extent_map *ext4fs_get_extent_map(struct ext2fs_node *node);
+int ext4fs_extent_map_find(struct ext4_extent_map *map, lbaint_t fileblock);
+void ext4fs_free_extent_map(void);
 int ext4fs_read_file(struct ext2fs_node *node, loff_t pos, loff_t len,
 		     char *buf, loff_t *actread);
 int ext4fs_find_file(const char *path, struct ext2fs_node *rootnode,
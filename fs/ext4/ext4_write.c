@@ -702,6 +702,9 @@ void ext4fs_deinit(void)
 	struct ext_filesystem *fs = get_fs();
 	uint32_t new_feature_incompat;
 
+	/* the write may have changed the extents of any file */
+	ext4fs_free_extent_map();
+
 	/* free journal */
 	char *temp_buff = zalloc(fs->blksz);
 	if (temp_buff) {
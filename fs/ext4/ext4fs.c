@@ -29,6 +29,7 @@
 #include <malloc.h>
 #include <part.h>
 #include <uuid.h>
+#include <linux/sizes.h>
 
 int ext4fs_symlinknest;
 struct ext_filesystem ext_fs;
@@ -44,6 +45,62 @@ void ext4fs_free_node(struct ext2fs_node *node, struct ext2fs_node *currroot)
 		free(node);
 }
 
+/* Largest single device read, to keep within the range of fs_devread() */
+#define EXT4_READ_CHUNK		SZ_1G
+
+/*
+ * Read part of a file using its extent map: each run is read from the device
+ * with one large read straight into @buf, and holes are zeroed.
+ */
+static int ext4fs_read_extents(struct ext2fs_node *node,
+			       struct ext4_extent_map *map, loff_t pos,
+			       loff_t len, char *buf)
+{
+	struct blk_desc *desc = get_fs()->dev_desc;
+	int log2_fs_blocksize = LOG2_BLOCK_SIZE(node->data);
+	loff_t end = pos + len;
+	int i;
+
+	i = ext4fs_extent_map_find(map, pos >> log2_fs_blocksize);
+	while (pos < end) {
+		struct ext4_extent_run *run = NULL;
+		loff_t run_start = end, run_end;
+		loff_t n;
+
+		if (i < map->count) {
+			run = &map->runs[i];
+			run_start = (loff_t)run->lblk << log2_fs_blocksize;
+		}
+		if (pos < run_start) {
+			/* Hole before the next run */
+			n = min(end, run_start) - pos;
+			memset(buf, '\0', n);
+		} else {
+			uint64_t byte;
+
+			run_end = (loff_t)(run->lblk + run->len) <<
+				log2_fs_blocksize;
+			n = min3(end, run_end, pos + EXT4_READ_CHUNK) - pos;
+			if (run->pblk) {
+				byte = (run->pblk << log2_fs_blocksize) +
+					pos - run_start;
+				if (!ext4fs_devread(byte >> desc->log2blksz,
+						    byte & (desc->blksz - 1),
+						    n, buf))
+					return -1;
+			} else {
+				memset(buf, '\0', n);
+			}
+			if (pos + n == run_end)
+				i++;
+		}
+		pos += n;
+		buf += n;
+	}
+
+	return 0;
+}
+
 /*
  * Taken from openmoko-kernel mailing list: By Andy green
  * Optimized read file API : collects and defers contiguous sector
@@ -80,6 +137,18 @@ int ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 		return -1;
 	}
 
+	if (le32_to_cpu(node->inode.flags) & EXT4_EXTENTS_FL) {
+		struct ext4_extent_map *map = ext4fs_get_extent_map(node);
+
+		/* Fall back to block-by-block lookup if the map is unusable */
+		if (map) {
+			if (ext4fs_read_extents(node, map, pos, len, buf))
+				return -1;
+			*actread = len;
+			return 0;
+		}
+	}
+
 	blockcnt = lldiv(((len + pos) + blocksize - 1), blocksize);
 
 	for (i = lldiv(pos, blocksize); i < blockcnt; i++) {
@@ -148,17 +148,110 @@ static void get_name(dir_entry *dirent, char *s_name)
 		*s_name = DELETED_FLAG;
 }
 
-static int flush_dirty_fat_buffer(fsdata *mydata);
+static int flush_fat_window(fsdata *mydata, int idx);
 
 #if !CONFIG_IS_ENABLED(FAT_WRITE)
 /* Stub for read only operation */
-int flush_dirty_fat_buffer(fsdata *mydata)
+int flush_fat_window(fsdata *mydata, int idx)
 {
 	(void)(mydata);
+	(void)(idx);
 	return 0;
 }
 #endif
 
+/**
+ * fat_cache_init() - allocate the FAT buffer
+ *
+ * Small FAT tables are cached as a whole, larger ones in fatwins windows of
+ * FATBUFBLOCKS sectors each, which are replaced in LRU order.
+ *
+ * @mydata:	file system description, FAT geometry must be set
+ * Return:	0 on success, -1 if out of memory
+ */
+static int fat_cache_init(fsdata *mydata)
+{
+	u64 fatbytes = (u64)mydata->fatlength * mydata->sect_size;
+	int i;
+
+	mydata->fatbuf = NULL;
+	if (!IS_ENABLED(CONFIG_SPL_BUILD) &&
+	    fatbytes <= CONFIG_FS_FAT_CACHE_WHOLE_SIZE) {
+		/* Keep FAT12 entries from straddling the end of the buffer */
+		mydata->fatbufblocks = roundup(mydata->fatlength, 3);
+		mydata->fatwins = 1;
+		mydata->fatbuf = malloc_cache_aligned(FATBUFSIZE);
+	}
+	if (!mydata->fatbuf) {
+		mydata->fatbufblocks = FATBUFBLOCKS;
+		mydata->fatwins = FATCACHEWINS;
+		mydata->fatbuf = malloc_cache_aligned(FATBUFSIZE *
+						      mydata->fatwins);
+		if (!mydata->fatbuf)
+			return -1;
+	}
+
+	for (i = 0; i < mydata->fatwins; i++) {
+		mydata->fatwin[i].num = -1;
+		mydata->fatwin[i].dirty = 0;
+		mydata->fatwin[i].lru = 0;
+	}
+	mydata->fatuse = 0;
+
+	return 0;
+}
+
+/**
+ * fat_cache_get() - get the FAT buffer window holding a part of the FAT
+ *
+ * If the window is not cached yet the least recently used one is written
+ * back if needed and replaced.
+ *
+ * @mydata:	file system description
+ * @bufnum:	number of the window in the FAT
+ * Return:	index of the window in the FAT buffer, -1 on error
+ */
+static int fat_cache_get(fsdata *mydata, __u32 bufnum)
+{
+	struct fat_cache_win *win;
+	__u32 getsize = mydata->fatbufblocks;
+	__u32 startblock = bufnum * mydata->fatbufblocks;
+	int i, idx = 0;
+
+	for (i = 0; i < mydata->fatwins; i++) {
+		win = &mydata->fatwin[i];
+		if (win->num == (int)bufnum) {
+			win->lru = ++mydata->fatuse;
+			return i;
+		}
+		if (win->lru < mydata->fatwin[idx].lru)
+			idx = i;
+	}
+
+	/* Write back the evicted window to the disk */
+	if (flush_fat_window(mydata, idx) < 0)
+		return -1;
+
+	win = &mydata->fatwin[idx];
+	win->num = -1;
+
+	/* Cap length if fatlength is not a multiple of the window size */
+	if (startblock + getsize > mydata->fatlength)
+		getsize = mydata->fatlength - startblock;
+
+	startblock += mydata->fat_sect;	/* Offset from start of disk */
+
+	if (disk_read(startblock, getsize, mydata->fatbuf +
+		      idx * FATBUFSIZE) < 0) {
+		debug("Error reading FAT blocks\n");
+		return -1;
+	}
+	win->num = bufnum;
+	win->lru = ++mydata->fatuse;
+
+	return idx;
+}
+
 /*
  * Get the entry at index 'entry' in a FAT (12/16/32) table.
  * On failure 0x00 is returned.
@@ -168,6 +261,8 @@ static __u32 get_fatent(fsdata *mydata, __u32 entry)
 	__u32 bufnum;
 	__u32 offset, off8;
 	__u32 ret = 0x00;
+	__u8 *fatbuf;
+	int idx;
 
 	if (CHECK_CLUST(entry, mydata->fatsize)) {
 		log_err("Invalid FAT entry: %#08x\n", entry);
@@ -197,41 +292,23 @@ static __u32 get_fatent(fsdata *mydata, __u32 entry)
 	       mydata->fatsize, entry, entry, offset, offset);
 
 	/* Read a new block of FAT entries into the cache. */
-	if (bufnum != mydata->fatbufnum) {
-		__u32 getsize = FATBUFBLOCKS;
-		__u8 *bufptr = mydata->fatbuf;
-		__u32 fatlength = mydata->fatlength;
-		__u32 startblock = bufnum * FATBUFBLOCKS;
-
-		/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
-		if (startblock + getsize > fatlength)
-			getsize = fatlength - startblock;
-
-		startblock += mydata->fat_sect;	/* Offset from start of disk */
-
-		/* Write back the fatbuf to the disk */
-		if (flush_dirty_fat_buffer(mydata) < 0)
-			return -1;
-
-		if (disk_read(startblock, getsize, bufptr) < 0) {
-			debug("Error reading FAT blocks\n");
-			return ret;
-		}
-		mydata->fatbufnum = bufnum;
-	}
+	idx = fat_cache_get(mydata, bufnum);
+	if (idx < 0)
+		return ret;
+	fatbuf = mydata->fatbuf + idx * FATBUFSIZE;
 
 	/* Get the actual entry from the table */
 	switch (mydata->fatsize) {
 	case 32:
-		ret = FAT2CPU32(((__u32 *) mydata->fatbuf)[offset]);
+		ret = FAT2CPU32(((__u32 *) fatbuf)[offset]);
 		break;
 	case 16:
-		ret = FAT2CPU16(((__u16 *) mydata->fatbuf)[offset]);
+		ret = FAT2CPU16(((__u16 *) fatbuf)[offset]);
 		break;
 	case 12:
 		off8 = (offset * 3) / 2;
 		/* fatbut + off8 may be unaligned, read in byte granularity */
-		ret = mydata->fatbuf[off8] + (mydata->fatbuf[off8 + 1] << 8);
+		ret = fatbuf[off8] + (fatbuf[off8 + 1] << 8);
 
 		if (offset & 0x1)
 			ret >>= 4;
@@ -262,21 +339,40 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
 	debug("gc - clustnum: %d, startsect: %d\n", clustnum, startsect);
 
 	if ((unsigned long)buffer & (ARCH_DMA_MINALIGN - 1)) {
-		ALLOC_CACHE_ALIGN_BUFFER(__u8, tmpbuf, mydata->sect_size);
+		__u32 sect_count = min(size / mydata->sect_size,
+				       (unsigned long)FATBOUNCEBLOCKS);
+		__u8 *tmpbuf = NULL;
 
 		debug("FAT: Misaligned buffer address (%p)\n", buffer);
 
+		if (sect_count) {
+			tmpbuf = malloc_cache_aligned(sect_count *
+						      mydata->sect_size);
+			if (!tmpbuf) {
+				debug("Error: allocating buffer\n");
+				return -1;
+			}
+		}
+
+		/* Read through a bounce buffer, in as few requests as we can */
 		while (size >= mydata->sect_size) {
-			ret = disk_read(startsect++, 1, tmpbuf);
-			if (ret != 1) {
+			__u32 count = min(size / mydata->sect_size,
+					  (unsigned long)sect_count);
+			__u32 bytes = count * mydata->sect_size;
+
+			ret = disk_read(startsect, count, tmpbuf);
+			if (ret != count) {
 				debug("Error reading data (got %d)\n", ret);
+				free(tmpbuf);
 				return -1;
 			}
 
-			memcpy(buffer, tmpbuf, mydata->sect_size);
-			buffer += mydata->sect_size;
-			size -= mydata->sect_size;
+			memcpy(buffer, tmpbuf, bytes);
+			startsect += count;
+			buffer += bytes;
+			size -= bytes;
 		}
+		free(tmpbuf);
 	} else if (size >= mydata->sect_size) {
 		__u32 bytes_read;
 		__u32 sect_count = size / mydata->sect_size;
@@ -414,18 +510,18 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 
 		/* get remaining bytes */
 		actsize = filesize;
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
+		if (get_cluster(mydata, curclust, buffer, actsize) != 0) {
 			printf("Error reading cluster\n");
 			return -1;
 		}
 		*gotsize += actsize;
 		return 0;
 getit:
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
+		if (get_cluster(mydata, curclust, buffer, actsize) != 0) {
 			printf("Error reading cluster\n");
 			return -1;
 		}
-		*gotsize += (int)actsize;
+		*gotsize += actsize;
 		filesize -= actsize;
 		buffer += actsize;
 
@@ -625,10 +721,7 @@ static int get_fs_info(fsdata *mydata)
 		mydata->root_cluster = 0;
 	}
 
-	mydata->fatbufnum = -1;
-	mydata->fat_dirty = 0;
-	mydata->fatbuf = malloc_cache_aligned(FATBUFSIZE);
-	if (mydata->fatbuf == NULL) {
+	if (fat_cache_init(mydata)) {
 		debug("Error: allocating memory\n");
 		return -1;
 	}
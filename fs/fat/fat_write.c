@@ -213,22 +213,24 @@ static int disk_write(__u32 block, __u32 nr_blocks, void *buf)
 }
 
 /*
- * Write fat buffer into block device
+ * Write a window of the fat buffer into block device
  */
-static int flush_dirty_fat_buffer(fsdata *mydata)
+static int flush_fat_window(fsdata *mydata, int idx)
 {
-	int getsize = FATBUFBLOCKS;
+	struct fat_cache_win *win = &mydata->fatwin[idx];
+	__u32 getsize = mydata->fatbufblocks;
 	__u32 fatlength = mydata->fatlength;
-	__u8 *bufptr = mydata->fatbuf;
-	__u32 startblock = mydata->fatbufnum * FATBUFBLOCKS;
+	__u8 *bufptr = mydata->fatbuf + idx * FATBUFSIZE;
+	__u32 startblock;
 
-	debug("debug: evicting %d, dirty: %d\n", mydata->fatbufnum,
-	      (int)mydata->fat_dirty);
+	debug("debug: evicting %d, dirty: %d\n", win->num, (int)win->dirty);
 
-	if ((!mydata->fat_dirty) || (mydata->fatbufnum == -1))
+	if ((!win->dirty) || (win->num == -1))
 		return 0;
 
-	/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
+	startblock = win->num * mydata->fatbufblocks;
+
+	/* Cap length if fatlength is not a multiple of the window size */
 	if (startblock + getsize > fatlength)
 		getsize = fatlength - startblock;
 
@@ -248,7 +250,22 @@ static int flush_dirty_fat_buffer(fsdata *mydata)
 			return -1;
 		}
 	}
-	mydata->fat_dirty = 0;
+	win->dirty = 0;
+
+	return 0;
+}
+
+/*
+ * Write all modified windows of the fat buffer into block device
+ */
+static int flush_dirty_fat_buffer(fsdata *mydata)
+{
+	int i;
+
+	for (i = 0; i < mydata->fatwins; i++) {
+		if (flush_fat_window(mydata, i) < 0)
+			return -1;
+	}
 
 	return 0;
 }
@@ -442,6 +459,8 @@ static int set_fatent_value(fsdata *mydata, __u32 entry, __u32 entry_value)
 {
 	__u32 bufnum, offset, off16;
 	__u16 val1, val2;
+	__u8 *fatbuf;
+	int idx;
 
 	switch (mydata->fatsize) {
 	case 32:
@@ -462,38 +481,21 @@ static int set_fatent_value(fsdata *mydata, __u32 entry, __u32 entry_value)
 	}
 
 	/* Read a new block of FAT entries into the cache. */
-	if (bufnum != mydata->fatbufnum) {
-		int getsize = FATBUFBLOCKS;
-		__u8 *bufptr = mydata->fatbuf;
-		__u32 fatlength = mydata->fatlength;
-		__u32 startblock = bufnum * FATBUFBLOCKS;
-
-		/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
-		if (startblock + getsize > fatlength)
-			getsize = fatlength - startblock;
-
-		if (flush_dirty_fat_buffer(mydata) < 0)
-			return -1;
-
-		startblock += mydata->fat_sect;
-
-		if (disk_read(startblock, getsize, bufptr) < 0) {
-			debug("Error reading FAT blocks\n");
-			return -1;
-		}
-		mydata->fatbufnum = bufnum;
-	}
+	idx = fat_cache_get(mydata, bufnum);
+	if (idx < 0)
+		return -1;
+	fatbuf = mydata->fatbuf + idx * FATBUFSIZE;
 
-	/* Mark as dirty */
-	mydata->fat_dirty = 1;
+	/* Mark as dirty, written back on eviction or flush */
+	mydata->fatwin[idx].dirty = 1;
 
 	/* Set the actual entry */
 	switch (mydata->fatsize) {
 	case 32:
-		((__u32 *) mydata->fatbuf)[offset] = cpu_to_le32(entry_value);
+		((__u32 *) fatbuf)[offset] = cpu_to_le32(entry_value);
 		break;
 	case 16:
-		((__u16 *) mydata->fatbuf)[offset] = cpu_to_le16(entry_value);
+		((__u16 *) fatbuf)[offset] = cpu_to_le16(entry_value);
 		break;
 	case 12:
 		off16 = (offset * 3) / 4;
@@ -501,33 +503,33 @@ static int set_fatent_value(fsdata *mydata, __u32 entry, __u32 entry_value)
 		switch (offset & 0x3) {
 		case 0:
 			val1 = cpu_to_le16(entry_value) & 0xfff;
-			((__u16 *)mydata->fatbuf)[off16] &= ~0xfff;
-			((__u16 *)mydata->fatbuf)[off16] |= val1;
+			((__u16 *)fatbuf)[off16] &= ~0xfff;
+			((__u16 *)fatbuf)[off16] |= val1;
 			break;
 		case 1:
 			val1 = cpu_to_le16(entry_value) & 0xf;
 			val2 = (cpu_to_le16(entry_value) >> 4) & 0xff;
 
-			((__u16 *)mydata->fatbuf)[off16] &= ~0xf000;
-			((__u16 *)mydata->fatbuf)[off16] |= (val1 << 12);
+			((__u16 *)fatbuf)[off16] &= ~0xf000;
+			((__u16 *)fatbuf)[off16] |= (val1 << 12);
 
-			((__u16 *)mydata->fatbuf)[off16 + 1] &= ~0xff;
-			((__u16 *)mydata->fatbuf)[off16 + 1] |= val2;
+			((__u16 *)fatbuf)[off16 + 1] &= ~0xff;
+			((__u16 *)fatbuf)[off16 + 1] |= val2;
 			break;
 		case 2:
 			val1 = cpu_to_le16(entry_value) & 0xff;
 			val2 = (cpu_to_le16(entry_value) >> 8) & 0xf;
 
-			((__u16 *)mydata->fatbuf)[off16] &= ~0xff00;
-			((__u16 *)mydata->fatbuf)[off16] |= (val1 << 8);
+			((__u16 *)fatbuf)[off16] &= ~0xff00;
+			((__u16 *)fatbuf)[off16] |= (val1 << 8);
 
-			((__u16 *)mydata->fatbuf)[off16 + 1] &= ~0xf;
-			((__u16 *)mydata->fatbuf)[off16 + 1] |= val2;
+			((__u16 *)fatbuf)[off16 + 1] &= ~0xf;
+			((__u16 *)fatbuf)[off16 + 1] |= val2;
 			break;
 		case 3:
 			val1 = cpu_to_le16(entry_value) & 0xfff;
-			((__u16 *)mydata->fatbuf)[off16] &= ~0xfff0;
-			((__u16 *)mydata->fatbuf)[off16] |= (val1 << 4);
+			((__u16 *)fatbuf)[off16] &= ~0xfff0;
+			((__u16 *)fatbuf)[off16] |= (val1 << 4);
 			break;
 		default:
 			break;
@@ -849,9 +851,6 @@ static int new_dir_table(fat_itr *itr)
 	else if (mydata->fatsize == 12)
 		set_fatent_value(mydata, dir_newclust, 0xff8);
 
-	if (flush_dirty_fat_buffer(mydata) < 0)
-		return -EIO;
-
 	itr->dent = (dir_entry *)itr->block;
 	itr->last_cluster = 1;
 	itr->remaining = bytesperclust / sizeof(dir_entry) - 1;
@@ -876,10 +875,6 @@ static int clear_fatent(fsdata *mydata, __u32 entry)
 		entry = fat_val;
 	}
 
-	/* Flush fat buffer */
-	if (flush_dirty_fat_buffer(mydata) < 0)
-		return -1;
-
 	return 0;
 }
 
@@ -1445,8 +1440,7 @@ int file_fat_write(const char *filename, void *buffer, loff_t offset,
 static int fat_dir_entries(fat_itr *itr)
 {
 	fat_itr *dirs;
-	fsdata fsdata = { .fatbuf = NULL, }, *mydata = &fsdata;
-						/* for FATBUFSIZE */
+	fsdata fsdata = { .fatbuf = NULL, };
 	int count;
 
 	dirs = malloc_cache_aligned(sizeof(fat_itr));
@@ -1456,18 +1450,20 @@ static int fat_dir_entries(fat_itr *itr)
 		goto exit;
 	}
 
-	/* duplicate fsdata */
+	/* duplicate fsdata, the copy must see pending FAT updates */
 	fat_itr_child(dirs, itr);
+	if (flush_dirty_fat_buffer(dirs->fsdata) < 0) {
+		count = -EIO;
+		goto exit;
+	}
 	fsdata = *dirs->fsdata;
 
 	/* allocate local fat buffer */
-	fsdata.fatbuf = malloc_cache_aligned(FATBUFSIZE);
-	if (!fsdata.fatbuf) {
+	if (fat_cache_init(&fsdata)) {
 		debug("Error: allocating memory\n");
 		count = -ENOMEM;
 		goto exit;
 	}
-	fsdata.fatbufnum = -1;
 	dirs->fsdata = &fsdata;
 
 	for (count = 0; fat_itr_next(dirs); count++)
@@ -39,6 +39,34 @@ static int fs_dev_part;
 static struct disk_partition fs_partition;
 static int fs_type = FS_TYPE_ANY;
 
+/**
+ * struct fs_mount - filesystem which stays mounted between operations
+ *
+ * With CONFIG_FS_MOUNT_CACHE, fs_close() leaves the filesystem mounted so that
+ * the next fs_set_blk_dev() on the same partition can skip the probe and use
+ * the state the filesystem driver already holds.
+ *
+ * @desc: block device holding the filesystem, NULL if none is mounted
+ * @part: partition number
+ * @hwpart: hardware partition selected on @desc when it was mounted
+ * @start: first block of the partition
+ * @size: number of blocks in the partition
+ * @fstype: filesystem type (FS_TYPE_...)
+ * @valid: false if the device was written or changed since it was mounted
+ */
+struct fs_mount {
+	struct blk_desc *desc;
+	int part;
+	int hwpart;
+	lbaint_t start;
+	lbaint_t size;
+	int fstype;
+	bool valid;
+};
+
+static struct fs_mount fs_mount;
+static struct fs_mount_stats fs_mount_stats;
+
 void fs_set_type(int type)
 {
 	fs_type = type;
@@ -418,6 +446,83 @@ const char *fs_get_type_name(void)
 	return fs_get_info(fs_type)->name;
 }
 
+/* Close the filesystem kept mounted by fs_close(), if any */
+static void fs_mount_release(void)
+{
+	if (fs_mount.desc) {
+		fs_get_info(fs_mount.fstype)->close();
+		fs_mount.desc = NULL;
+	}
+}
+
+/**
+ * fs_mount_reuse() - try to use the filesystem left mounted by fs_close()
+ *
+ * This must be called once fs_dev_desc and fs_partition are set up for the
+ * new partition. If the mounted filesystem cannot be used, it is closed.
+ *
+ * @part: partition number
+ * @fstype: filesystem type wanted, or FS_TYPE_ANY
+ * Return: true if the mounted filesystem is now the current one
+ */
+static bool fs_mount_reuse(int part, int fstype)
+{
+	struct fs_mount *mnt = &fs_mount;
+
+	if (!CONFIG_IS_ENABLED(FS_MOUNT_CACHE))
+		return false;
+
+	if (mnt->desc && mnt->valid && mnt->desc == fs_dev_desc &&
+	    mnt->part == part && mnt->hwpart == fs_dev_desc->hwpart &&
+	    mnt->start == fs_partition.start &&
+	    mnt->size == fs_partition.size &&
+	    (fstype == FS_TYPE_ANY || fstype == mnt->fstype)) {
+		fs_type = mnt->fstype;
+		fs_dev_part = part;
+		fs_mount_stats.saved++;
+		return true;
+	}
+	fs_mount_release();
+
+	return false;
+}
+
+/* Record the filesystem just probed so that fs_close() can keep it */
+static void fs_mount_set(int part)
+{
+	if (!CONFIG_IS_ENABLED(FS_MOUNT_CACHE) || !fs_dev_desc)
+		return;
+
+	fs_mount.desc = fs_dev_desc;
+	fs_mount.part = part;
+	fs_mount.hwpart = fs_dev_desc->hwpart;
+	fs_mount.start = fs_partition.start;
+	fs_mount.size = fs_partition.size;
+	fs_mount.fstype = fs_type;
+	fs_mount.valid = true;
+}
+
+#if CONFIG_IS_ENABLED(FS_MOUNT_CACHE)
+void fs_mount_invalidate(struct blk_desc *desc)
+{
+	if (!desc || fs_mount.desc == desc)
+		fs_mount.valid = false;
+}
+
+void fs_mount_flush(void)
+{
+	fs_mount_release();
+}
+
+void fs_mount_get_stats(struct fs_mount_stats *stats)
+{
+	*stats = fs_mount_stats;
+	stats->desc = fs_mount.valid ? fs_mount.desc : NULL;
+	stats->part = fs_mount.part;
+	stats->name = fs_get_info(fs_mount.fstype)->name;
+}
+#endif
+
 int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 {
 	struct fstype_info *info;
@@ -444,6 +549,9 @@ int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 	if (part < 0)
 		return -1;
 
+	if (fs_dev_desc && fs_mount_reuse(part, fstype))
+		return 0;
+
 	for (i = 0, info = fstypes; i < ARRAY_SIZE(fstypes); i++, info++) {
 		if (fstype != FS_TYPE_ANY && info->fstype != FS_TYPE_ANY &&
 				fstype != info->fstype)
@@ -452,9 +560,11 @@ int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 		if (!fs_dev_desc && !info->null_dev_desc_ok)
 			continue;
 
+		fs_mount_stats.probes++;
 		if (!info->probe(fs_dev_desc, &fs_partition)) {
 			fs_type = info->fstype;
 			fs_dev_part = part;
+			fs_mount_set(part);
 			return 0;
 		}
 	}
@@ -476,10 +586,15 @@ int fs_set_blk_dev_with_part(struct blk_desc *desc, int part)
 		return ret;
 	fs_dev_desc = desc;
 
+	if (fs_mount_reuse(part, FS_TYPE_ANY))
+		return 0;
+
 	for (i = 0, info = fstypes; i < ARRAY_SIZE(fstypes); i++, info++) {
+		fs_mount_stats.probes++;
 		if (!info->probe(fs_dev_desc, &fs_partition)) {
 			fs_type = info->fstype;
 			fs_dev_part = part;
+			fs_mount_set(part);
 			return 0;
 		}
 	}
@@ -491,11 +606,25 @@ void fs_close(void)
 {
 	struct fstype_info *info = fs_get_info(fs_type);
 
-	info->close();
+	/* Keep the filesystem mounted unless its device has changed */
+	if (fs_mount.desc && fs_mount.desc == fs_dev_desc &&
+	    fs_mount.fstype == fs_type) {
+		if (!fs_mount.valid)
+			fs_mount_release();
+	} else {
+		info->close();
+	}
 
 	fs_type = FS_TYPE_ANY;
 }
 
+/* Close the filesystem after it has been written, dropping any kept mount */
+static void fs_close_written(void)
+{
+	fs_mount_invalidate(fs_dev_desc);
+	fs_close();
+}
+
 int fs_uuid(char *uuid_str)
 {
 	struct fstype_info *info = fs_get_info(fs_type);
@@ -629,7 +758,7 @@ int fs_write(const char *filename, ulong addr, loff_t offset, loff_t len,
 		log_err("** Unable to write file %s **\n", filename);
 		ret = -1;
 	}
-	fs_close();
+	fs_close_written();
 
 	return ret;
 }
@@ -694,7 +823,7 @@ int fs_unlink(const char *filename)
 
 	ret = info->unlink(filename);
 
-	fs_close();
+	fs_close_written();
 
 	return ret;
 }
@@ -707,7 +836,7 @@ int fs_mkdir(const char *dirname)
 
 	ret = info->mkdir(dirname);
 
-	fs_close();
+	fs_close_written();
 
 	return ret;
 }
@@ -723,7 +852,7 @@ int fs_ln(const char *fname, const char *target)
 		log_err("** Unable to create link %s -> %s **\n", fname, target);
 		ret = -1;
 	}
-	fs_close();
+	fs_close_written();
 
 	return ret;
 }
@@ -103,6 +103,14 @@ struct blk_desc {
 #define PAD_TO_BLOCKSIZE(size, blk_desc) \
 	(PAD_SIZE(size, blk_desc->blksz))
 
+/**
+ * typedef blkcache_read_op - function which reads blocks from a device
+ *
+ * This has the same arguments and return value as &blk_ops.read
+ */
+typedef ulong (*blkcache_read_op)(struct udevice *dev, lbaint_t start,
+				  lbaint_t blkcnt, void *buffer);
+
 #if CONFIG_IS_ENABLED(BLOCK_CACHE)
 
 /**
@@ -110,6 +118,27 @@ struct blk_desc {
  */
 int blkcache_init(void);
 
+/**
+ * blkcache_read_through() - read a set of blocks, using the cache
+ *
+ * Blocks found in the cache at either end of the range are copied from it
+ * and only the remaining blocks are read from the device. Small reads which
+ * continue a sequential access pattern on the device also read ahead into
+ * the cache, with the window growing while the pattern persists.
+ *
+ * @desc: block device descriptor, used for the cache key and block size
+ * @read: function used to read blocks which are not in the cache
+ * @dev: device to pass to @read
+ * @start: starting block number
+ * @blkcnt: number of blocks to read
+ * @buffer: buffer to contain the data
+ * Return: number of blocks read, or -ve error number (see the IS_ERR_VALUE()
+ * macro)
+ */
+ulong blkcache_read_through(struct blk_desc *desc, blkcache_read_op read,
+			    struct udevice *dev, lbaint_t start,
+			    lbaint_t blkcnt, void *buffer);
+
 /**
  * blkcache_read() - attempt to read a set of blocks from cache
  *
@@ -154,10 +183,10 @@ void blkcache_invalidate(int iftype, int dev);
 /**
  * blkcache_configure() - configure block cache
  *
- * @param blocks - maximum blocks per entry
- * @param entries - maximum entries in cache
+ * @max_bytes: memory budget of the cache in bytes, 0 to disable it
+ * @max_readahead: maximum number of blocks to read ahead, 0 to disable
  */
-void blkcache_configure(unsigned blocks, unsigned entries);
+void blkcache_configure(unsigned long max_bytes, unsigned int max_readahead);
 
 /*
  * statistics of the block cache
@@ -165,9 +194,14 @@ void blkcache_configure(unsigned blocks, unsigned entries);
 struct block_cache_stats {
 	unsigned hits;
 	unsigned misses;
+	unsigned partial_hits; /* reads partly served from the cache */
+	unsigned evictions; /* entries dropped to stay within budget */
+	unsigned readahead; /* blocks read ahead of a sequential reader */
 	unsigned entries; /* current entry count */
-	unsigned max_blocks_per_entry;
-	unsigned max_entries;
+	unsigned blocks_per_entry;
+	unsigned max_readahead;
+	unsigned long mem_used; /* bytes currently allocated */
+	unsigned long max_bytes;
 };
 
 /**
@@ -182,6 +216,14 @@ void blkcache_free(void);
 
 #else
 
+static inline ulong blkcache_read_through(struct blk_desc *desc,
+					  blkcache_read_op read,
+					  struct udevice *dev, lbaint_t start,
+					  lbaint_t blkcnt, void *buffer)
+{
+	return read(dev, start, blkcnt, buffer);
+}
+
 static inline int blkcache_read(int iftype, int dev,
 				lbaint_t start, lbaint_t blkcnt,
 				unsigned long blksz, void *buffer)
@@ -25,12 +25,15 @@ struct disk_partition;
 #define DIRENTSPERCLUST	((mydata->clust_size * mydata->sect_size) / \
 			 sizeof(dir_entry))
 
-#define FATBUFBLOCKS	6
-#define FATBUFSIZE	(mydata->sect_size * FATBUFBLOCKS)
+#define FATBUFBLOCKS	6	/* Window size, multiple of 3 for FAT12 */
+#define FATBUFSIZE	(mydata->sect_size * mydata->fatbufblocks)
 #define FAT12BUFSIZE	((FATBUFSIZE*2)/3)
 #define FAT16BUFSIZE	(FATBUFSIZE/2)
 #define FAT32BUFSIZE	(FATBUFSIZE/4)
 
+/* Sectors read at once into a misaligned destination */
+#define FATBOUNCEBLOCKS	128
+
 /* Maximum number of entry for long file name according to spec */
 #define MAX_LFN_SLOT	20
 
@@ -161,6 +164,21 @@ typedef struct dir_slot {
 	__u8	name11_12[4];	/* Last 2 characters in name */
 } dir_slot;
 
+#ifdef CONFIG_FS_FAT_CACHE_WINDOWS
+#define FATCACHEWINS	CONFIG_FS_FAT_CACHE_WINDOWS
+#else
+#define FATCACHEWINS	1
+#endif
+
+/*
+ * A window of the FAT table held in the FAT buffer
+ */
+struct fat_cache_win {
+	int	num;		/* Window number in the FAT, -1 if unused */
+	__u8	dirty;		/* Set if the window has been modified */
+	ulong	lru;		/* Last use, the oldest window is evicted */
+};
+
 /*
  * Private filesystem parameters
  *
@@ -168,16 +186,18 @@ typedef struct dir_slot {
  * (see FAT32 accesses)
  */
 typedef struct {
-	__u8	*fatbuf;	/* Current FAT buffer */
+	__u8	*fatbuf;	/* FAT buffer, fatwins windows of FATBUFSIZE */
 	int	fatsize;	/* Size of FAT in bits */
 	__u32	fatlength;	/* Length of FAT in sectors */
 	__u16	fat_sect;	/* Starting sector of the FAT */
-	__u8	fat_dirty;      /* Set if fatbuf has been modified */
 	__u32	rootdir_sect;	/* Start sector of root directory */
 	__u16	sect_size;	/* Size of sectors in bytes */
 	__u16	clust_size;	/* Size of clusters in sectors */
 	int	data_begin;	/* The sector of the first cluster, can be negative */
-	int	fatbufnum;	/* Used by get_fatent, init to -1 */
+	int	fatbufblocks;	/* Size of a FAT buffer window in sectors */
+	int	fatwins;	/* Number of windows in the FAT buffer */
+	ulong	fatuse;		/* Counter for the window LRU */
+	struct fat_cache_win fatwin[FATCACHEWINS];
 	int	rootdir_size;	/* Size of root dir for non-FAT32 */
 	__u32	root_cluster;	/* First cluster of root dir for FAT32 */
 	u32	total_sect;	/* Number of sectors */
@@ -68,6 +68,51 @@ int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype);
  */
 void fs_set_type(int type);
 
+/**
+ * struct fs_mount_stats - information about the filesystem mount cache
+ *
+ * @probes: number of filesystem probes run
+ * @saved: number of probes avoided by reusing a mounted filesystem
+ * @desc: block device of the mounted filesystem, NULL if none
+ * @part: partition number of the mounted filesystem
+ * @name: filesystem type name of the mounted filesystem
+ */
+struct fs_mount_stats {
+	uint probes;
+	uint saved;
+	struct blk_desc *desc;
+	int part;
+	const char *name;
+};
+
+#if CONFIG_IS_ENABLED(FS_MOUNT_CACHE)
+/**
+ * fs_mount_invalidate() - stop reusing the filesystem mounted on a device
+ *
+ * This must be called when a block device is written, removed or its media
+ * changes, so that the state held by a mounted filesystem is not used again.
+ * The filesystem is closed on the next filesystem operation.
+ *
+ * @desc: block device which changed, or NULL for all devices
+ */
+void fs_mount_invalidate(struct blk_desc *desc);
+
+/**
+ * fs_mount_flush() - close the filesystem kept mounted by fs_close()
+ */
+void fs_mount_flush(void);
+
+/**
+ * fs_mount_get_stats() - get information about the mount cache
+ *
+ * @stats: returns the counters and the mounted filesystem
+ */
+void fs_mount_get_stats(struct fs_mount_stats *stats);
+#else
+static inline void fs_mount_invalidate(struct blk_desc *desc) {}
+static inline void fs_mount_flush(void) {}
+#endif
+
 /*
  * fs_set_blk_dev_with_part - Set current block device + partition
  *
@@ -45,6 +45,54 @@ int gunzip(void *dst, int dstlen, unsigned char *src, unsigned long *lenp);
 int zunzip(void *dst, int dstlen, unsigned char *src, unsigned long *lenp,
 	   int stoponerr, int offset);
 
+/**
+ * struct gunzip_stream - State of a gzip decompression fed in pieces
+ *
+ * @zs: zlib stream state
+ * @dst: Destination for uncompressed data
+ * @header: true once the gzip header has been skipped
+ * @done: true once the end of the compressed stream has been seen
+ */
+struct gunzip_stream {
+	void *zs;
+	void *dst;
+	bool header;
+	bool done;
+};
+
+/**
+ * gunzip_stream_init() - Start decompressing gzipped data in pieces
+ *
+ * @gs: Stream state to set up
+ * @dst: Destination for uncompressed data
+ * @dstlen: Size of destination buffer
+ * Return: 0 if OK, -ENOMEM if out of memory, -EIO on other error
+ */
+int gunzip_stream_init(struct gunzip_stream *gs, void *dst, ulong dstlen);
+
+/**
+ * gunzip_stream_feed() - Decompress the next piece of gzipped data
+ *
+ * The first piece must hold the complete gzip header. Data following the end
+ * of the compressed stream (the gzip trailer) is ignored.
+ *
+ * @gs: Stream state
+ * @src: Next piece of gzipped data
+ * @len: Length of the piece
+ * Return: 0 if OK, -ENOSPC if the destination is full, -EINVAL on a bad
+ *	header, -EIO on a decode error
+ */
+int gunzip_stream_feed(struct gunzip_stream *gs, const void *src, ulong len);
+
+/**
+ * gunzip_stream_finish() - Finish decompression and free the stream state
+ *
+ * @gs: Stream state
+ * @lenp: Returns length of uncompressed data
+ * Return: 0 if OK, -EIO if the compressed stream was incomplete
+ */
+int gunzip_stream_finish(struct gunzip_stream *gs, ulong *lenp);
+
 /**
  * gzwrite progress indicators: defined weak to allow board-specific
  * overrides:
@@ -377,6 +377,7 @@ struct bootm_headers {
 	void		*fit_hdr_setup;	/* x86 setup FIT image header */
 	const char	*fit_uname_setup; /* x86 setup subimage node name */
 	int		fit_noffset_setup;/* x86 setup subimage node offset */
+	bool		fit_prehashed;	/* config images were hashed up front */
 
 #ifndef USE_HOSTCC
 	struct image_info	os;		/* os image info */
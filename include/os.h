@@ -525,4 +525,22 @@ long os_get_time_offset(void);
  */
 void os_set_time_offset(long offset);
 
+/**
+ * os_thread_create() - start a host thread
+ *
+ * @threadp:	returns a handle for the thread, to pass to os_thread_join()
+ * @func:	function to run in the thread
+ * @arg:	argument to pass to @func
+ * Return:	0 if OK, -ve on error
+ */
+int os_thread_create(void **threadp, void *(*func)(void *), void *arg);
+
+/**
+ * os_thread_join() - wait for a host thread to finish
+ *
+ * @thread:	thread handle from os_thread_create()
+ * Return:	0 if OK, -ve on error
+ */
+int os_thread_join(void *thread);
+
 #endif
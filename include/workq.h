@@ -0,0 +1,135 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Running independent jobs on several CPUs
+ *
+ * U-Boot normally runs on a single CPU. This allows a caller to hand a set of
+ * independent, compute-only jobs (e.g. hashing images) to the secondary CPUs
+ * as well and wait for all of them to complete.
+ *
+ * Jobs which do not run on the boot CPU must not use malloc(), the driver
+ * model or the console, none of which are safe to call from several CPUs.
+ * schedule() does nothing on secondary CPUs.
+ */
+
+#ifndef __WORKQ_H
+#define __WORKQ_H
+
+#include <linux/types.h>
+
+/**
+ * struct workq_job - a job to run
+ *
+ * @func: Function to run, returns 0 if OK or -ve on error
+ * @priv: Private data for @func
+ * @ret: Set to the return value of @func once the job has run
+ * @cpu: Set to the number of the CPU which ran the job, 0 for the boot CPU
+ */
+struct workq_job {
+	int (*func)(struct workq_job *job);
+	void *priv;
+	int ret;
+	int cpu;
+};
+
+#if CONFIG_IS_ENABLED(WORKQ)
+/**
+ * workq_run() - run a set of jobs and wait for all of them to finish
+ *
+ * The jobs are spread over the available CPUs, including the boot CPU. If no
+ * secondary CPU can be started they all run on the boot CPU.
+ *
+ * @jobs: Jobs to run
+ * @count: Number of jobs
+ * Return: 0 if all jobs succeeded, else the error of the first job that failed
+ */
+int workq_run(struct workq_job *jobs, int count);
+
+/**
+ * workq_cpu() - get the number of the CPU running the caller
+ *
+ * Return: 0 on the boot CPU or when no jobs are running, else the number of
+ * the secondary CPU
+ */
+int workq_cpu(void);
+
+/**
+ * workq_get_cpus() - get the number of CPUs jobs can be spread over
+ *
+ * Return: number of CPUs, including the boot CPU
+ */
+int workq_get_cpus(void);
+#else
+static inline int workq_run(struct workq_job *jobs, int count)
+{
+	int ret = 0;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		jobs[i].cpu = 0;
+		jobs[i].ret = jobs[i].func(&jobs[i]);
+		if (jobs[i].ret && !ret)
+			ret = jobs[i].ret;
+	}
+
+	return ret;
+}
+
+static inline int workq_cpu(void)
+{
+	return 0;
+}
+
+static inline int workq_get_cpus(void)
+{
+	return 1;
+}
+#endif
+
+/* Arch-specific functions, see workq.c for the weak defaults */
+
+/**
+ * arch_workq_cpus() - get the number of CPUs which can run jobs
+ *
+ * Return: number of CPUs, including the boot CPU
+ */
+int arch_workq_cpus(void);
+
+/**
+ * arch_workq_start() - start a secondary CPU
+ *
+ * The CPU must call workq_secondary(@cpu) and then stop.
+ *
+ * @cpu: Number of the CPU to start, from 1 to arch_workq_cpus() - 1
+ * Return: 0 if OK, -ve on error
+ */
+int arch_workq_start(int cpu);
+
+/**
+ * arch_workq_finish() - clean up after a secondary CPU
+ *
+ * This is called once the CPU has returned from workq_secondary().
+ *
+ * @cpu: Number of the CPU
+ * Return: 0 if OK, -ve on error
+ */
+int arch_workq_finish(int cpu);
+
+/**
+ * arch_workq_cpu() - get the number of the CPU running the caller
+ *
+ * This is only called while jobs are running.
+ *
+ * Return: 0 for the boot CPU, else the number given to arch_workq_start()
+ */
+int arch_workq_cpu(void);
+
+/**
+ * workq_secondary() - run jobs on a secondary CPU
+ *
+ * This returns once no jobs are left to run.
+ *
+ * @cpu: Number of the CPU
+ */
+void workq_secondary(int cpu);
+
+#endif
@@ -82,6 +82,79 @@ int gunzip(void *dst, int dstlen, unsigned char *src, unsigned long *lenp)
 	return zunzip(dst, dstlen, src, lenp, 1, offset);
 }
 
+int gunzip_stream_init(struct gunzip_stream *gs, void *dst, ulong dstlen)
+{
+	z_stream *s;
+	int r;
+
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return -ENOMEM;
+	s->zalloc = gzalloc;
+	s->zfree = gzfree;
+
+	r = inflateInit2(s, -MAX_WBITS);
+	if (r != Z_OK) {
+		printf("Error: inflateInit2() returned %d\n", r);
+		free(s);
+		return -EIO;
+	}
+	s->next_out = dst;
+	s->avail_out = dstlen;
+
+	gs->zs = s;
+	gs->dst = dst;
+	gs->header = false;
+	gs->done = false;
+
+	return 0;
+}
+
+int gunzip_stream_feed(struct gunzip_stream *gs, const void *src, ulong len)
+{
+	z_stream *s = gs->zs;
+	int r;
+
+	if (!gs->header) {
+		int offset = gzip_parse_header(src, len);
+
+		if (offset < 0)
+			return -EINVAL;
+		src += offset;
+		len -= offset;
+		gs->header = true;
+	}
+
+	s->next_in = (unsigned char *)src;
+	s->avail_in = len;
+	while (!gs->done && s->avail_in) {
+		r = inflate(s, Z_NO_FLUSH);
+		if (r == Z_STREAM_END) {
+			gs->done = true;
+		} else if (r == Z_BUF_ERROR && !s->avail_out) {
+			puts("Error: uncompressed data too large\n");
+			return -ENOSPC;
+		} else if (r != Z_OK) {
+			printf("Error: inflate() returned %d\n", r);
+			return -EIO;
+		}
+	}
+
+	return 0;
+}
+
+int gunzip_stream_finish(struct gunzip_stream *gs, ulong *lenp)
+{
+	z_stream *s = gs->zs;
+
+	*lenp = s->next_out - (unsigned char *)gs->dst;
+	inflateEnd(s);
+	free(s);
+	gs->zs = NULL;
+
+	return gs->done ? 0 : -EIO;
+}
+
 #ifdef CONFIG_CMD_UNZIP
 __weak
 void gzwrite_progress_init(ulong expectedsize)
@@ -0,0 +1,122 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Running independent jobs on several CPUs
+ *
+ * The boot CPU starts as many secondary CPUs as are useful, then all of them
+ * take jobs from a shared list until none is left. CPUs claim a job with an
+ * atomic increment of the index of the next job, so no lock is needed.
+ */
+
+#define LOG_CATEGORY	LOGC_BOOT
+
+#include <common.h>
+#include <log.h>
+#include <workq.h>
+
+static struct {
+	struct workq_job *jobs;
+	int count;
+	int next;	/* index of the next job to claim */
+	int busy;	/* number of secondary CPUs still running jobs */
+	bool active;	/* jobs are running */
+} workq;
+
+__weak int arch_workq_cpus(void)
+{
+	return 1;
+}
+
+__weak int arch_workq_start(int cpu)
+{
+	return -ENOSYS;
+}
+
+__weak int arch_workq_finish(int cpu)
+{
+	return 0;
+}
+
+__weak int arch_workq_cpu(void)
+{
+	return 0;
+}
+
+static void workq_worker(int cpu)
+{
+	struct workq_job *job;
+	int i;
+
+	while (1) {
+		i = __atomic_fetch_add(&workq.next, 1, __ATOMIC_ACQ_REL);
+		if (i >= workq.count)
+			break;
+		job = &workq.jobs[i];
+		job->cpu = cpu;
+		job->ret = job->func(job);
+	}
+}
+
+void workq_secondary(int cpu)
+{
+	workq_worker(cpu);
+
+	/* Publish the results of our jobs before reporting completion */
+	__atomic_fetch_sub(&workq.busy, 1, __ATOMIC_RELEASE);
+}
+
+int workq_cpu(void)
+{
+	if (!__atomic_load_n(&workq.active, __ATOMIC_ACQUIRE))
+		return 0;
+
+	return arch_workq_cpu();
+}
+
+int workq_get_cpus(void)
+{
+	return min(arch_workq_cpus(), CONFIG_WORKQ_MAX_CPUS);
+}
+
+int workq_run(struct workq_job *jobs, int count)
+{
+	int cpus = min(workq_get_cpus(), count);
+	int started, cpu, i;
+	int ret = 0;
+
+	if (workq.active)
+		return -EBUSY;
+
+	workq.jobs = jobs;
+	workq.count = count;
+	workq.next = 0;
+	workq.busy = 0;
+	__atomic_store_n(&workq.active, true, __ATOMIC_RELEASE);
+
+	for (started = 1; started < cpus; started++) {
+		__atomic_fetch_add(&workq.busy, 1, __ATOMIC_RELEASE);
+		ret = arch_workq_start(started);
+		if (ret) {
+			log_debug("Cannot start CPU %d (err=%d)\n", started,
+				  ret);
+			__atomic_fetch_sub(&workq.busy, 1, __ATOMIC_RELEASE);
+			break;
+		}
+	}
+
+	workq_worker(0);
+	while (__atomic_load_n(&workq.busy, __ATOMIC_ACQUIRE))
+		;
+
+	for (cpu = 1; cpu < started; cpu++)
+		arch_workq_finish(cpu);
+	__atomic_store_n(&workq.active, false, __ATOMIC_RELEASE);
+
+	ret = 0;
+	for (i = 0; i < count; i++) {
+		if (jobs[i].ret && !ret)
+			ret = jobs[i].ret;
+	}
+	log_debug("%d jobs on %d CPUs: ret=%d\n", count, started, ret);
+
+	return ret;
+}
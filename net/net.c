@@ -648,6 +648,8 @@ restart:
 		 *	errors that may have happened.
 		 */
 		eth_rx();
+		if (IS_ENABLED(CONFIG_PROT_TCP))
+			tcp_flush_ack();
 
 		/*
 		 *	Abort if ctrl-c was pressed.
@@ -40,19 +40,46 @@ static u32 tcp_ack_edge;
 static int tcp_activity_count;
 
 /*
- * Search for TCP_SACK and review the comments before the code section
- * TCP_SACK is the number of packets at the front of the stream
+ * Data received past the first hole in the stream, the "hills", sorted by
+ * sequence number and never touching each other. The first hole starts at
+ * tcp_ack_edge. Any number of holes is handled, up to TCP_SACK hills.
  */
+static struct sack_edges tcp_hills[TCP_SACK];
+static int tcp_hill_count;
+static int tcp_hill_last;	/* hill holding the last segment, or -1 */
 
-enum pkt_state {PKT, NOPKT};
-struct sack_r {
-	struct sack_edges se;
-	enum pkt_state st;
-};
+/*
+ * Receive window in bytes and the shift the peer applies to the window
+ * field, which is 0 unless both sides sent the window scale option
+ */
+#define TCP_RCV_WND_DEFAULT	(PKTBUFSRX * TCP_MSS)
+#define TCP_MAX_WSCALE		14
+
+static ulong tcp_rcv_wnd = TCP_RCV_WND_DEFAULT;
+static int tcp_rcv_wscale;
+
+/* Options seen in the packet being processed */
+static bool tcp_opt_wscale;
+static bool tcp_opt_sack_ok;
 
-static struct sack_r edge_a[TCP_SACK];
-static unsigned int sack_idx;
-static unsigned int prev_len;
+/* The peer agreed to receive SACK options */
+static bool tcp_sack_ok;
+
+/* A FIN was received, maybe ahead of missing data, and its sequence number */
+static bool tcp_fin_seen;
+static u32 tcp_fin_seq;
+
+/*
+ * Delayed ACKs: one ACK is sent for every TCP_ACK_SEGMENTS data segments, or
+ * once no more packets are waiting, or at once when data is missing
+ */
+#define TCP_ACK_SEGMENTS	2
+
+static int tcp_ack_pending;
+static bool tcp_ack_now;
+static u16 tcp_ack_dport;
+static u16 tcp_ack_sport;
+static u32 tcp_ack_seq;
 
 /*
  * TCP lengths are stored as a rounded up number of 32 bit words.
@@ -107,6 +134,60 @@ void tcp_set_tcp_handler(rxhand_tcp *f)
 		tcp_packet_handler = dummy_handler;
 	else
 		tcp_packet_handler = f;
+	tcp_rcv_wnd = TCP_RCV_WND_DEFAULT;
+}
+
+/**
+ * tcp_set_rcv_window() - set the receive window
+ * @size: window size in bytes, up to CONFIG_PROT_TCP_WINDOW
+ *
+ * The handler must then accept any data within the window, in any order, as
+ * it is passed on as soon as it is received. This is reset to a few segments
+ * by tcp_set_tcp_handler().
+ */
+void tcp_set_rcv_window(ulong size)
+{
+	tcp_rcv_wnd = clamp_t(ulong, size, TCP_MSS, CONFIG_PROT_TCP_WINDOW);
+}
+
+/* Sequence number comparisons, which must cope with wrapping around */
+static inline bool tcp_seq_before(u32 a, u32 b)
+{
+	return (s32)(a - b) < 0;
+}
+
+static inline bool tcp_seq_after(u32 a, u32 b)
+{
+	return (s32)(a - b) > 0;
+}
+
+/**
+ * tcp_get_wscale() - get the window scale to send in a SYN
+ *
+ * Return: smallest shift which fits the largest window in 16 bits
+ */
+static int tcp_get_wscale(void)
+{
+	int scale = 0;
+
+	while ((CONFIG_PROT_TCP_WINDOW >> scale) > 0xffff &&
+	       scale < TCP_MAX_WSCALE)
+		scale++;
+
+	return scale;
+}
+
+/**
+ * tcp_get_window() - get the value of the window field
+ * @syn: true for a SYN, the window of which is never scaled
+ *
+ * Return: window field, in host order
+ */
+static u16 tcp_get_window(bool syn)
+{
+	ulong wnd = syn ? tcp_rcv_wnd : tcp_rcv_wnd >> tcp_rcv_wscale;
+
+	return min(wnd, 0xffffUL);
 }
 
 /**
@@ -147,6 +228,28 @@ u16 tcp_set_pseudo_header(uchar *pkt, struct in_addr src, struct in_addr dest,
 	return compute_ip_checksum(pkt + PSEUDO_PAD_SIZE, checksum_len);
 }
 
+/**
+ * tcp_update_sack() - choose the SACK blocks to send
+ *
+ * As RFC 2018 asks, the first block holds the segment received last. The
+ * others are the hills nearest to the left edge, which show the peer where
+ * the first holes are.
+ */
+static void tcp_update_sack(void)
+{
+	int n = 0;
+	int i;
+
+	if (tcp_sack_ok && tcp_hill_last >= 0)
+		tcp_lost.hill[n++] = tcp_hills[tcp_hill_last];
+	for (i = 0; tcp_sack_ok && i < tcp_hill_count &&
+	     n < TCP_SACK_HILLS - 1; i++) {
+		if (i != tcp_hill_last)
+			tcp_lost.hill[n++] = tcp_hills[i];
+	}
+	tcp_lost.len = TCP_OPT_LEN_2 + n * TCP_SACK_SIZE;
+}
+
 /**
  * net_set_ack_options() - set TCP options in acknowledge packets
  * @b: the packet
@@ -155,6 +258,8 @@ u16 tcp_set_pseudo_header(uchar *pkt, struct in_addr src, struct in_addr dest,
  */
 int net_set_ack_options(union tcp_build_pkt *b)
 {
+	int i;
+
 	b->sack.hdr.tcp_hlen = SHIFT_TO_TCPHDRLEN_FIELD(LEN_B_TO_DW(TCP_HDR_SIZE));
 
 	b->sack.t_opt.kind = TCP_O_TS;
@@ -165,24 +270,24 @@ int net_set_ack_options(union tcp_build_pkt *b)
 	b->sack.sack_v.len = 0;
 
 	if (IS_ENABLED(CONFIG_PROT_TCP_SACK)) {
+		tcp_update_sack();
 		if (tcp_lost.len > TCP_OPT_LEN_2) {
 			debug_cond(DEBUG_DEV_PKT, "TCP ack opt lost.len %x\n",
 				   tcp_lost.len);
 			b->sack.sack_v.len = tcp_lost.len;
 			b->sack.sack_v.kind = TCP_V_SACK;
-			b->sack.sack_v.hill[0].l = htonl(tcp_lost.hill[0].l);
-			b->sack.sack_v.hill[0].r = htonl(tcp_lost.hill[0].r);
 
 			/*
-			 * These SACK structures are initialized with NOPs to
-			 * provide TCP header alignment padding. There are 4
-			 * SACK structures used for both header padding and
-			 * internally.
+			 * Only the blocks within tcp_lost.len are sent. The
+			 * last SACK structure is initialized with NOPs to
+			 * provide TCP header alignment padding.
 			 */
-			b->sack.sack_v.hill[1].l = htonl(tcp_lost.hill[1].l);
-			b->sack.sack_v.hill[1].r = htonl(tcp_lost.hill[1].r);
-			b->sack.sack_v.hill[2].l = htonl(tcp_lost.hill[2].l);
-			b->sack.sack_v.hill[2].r = htonl(tcp_lost.hill[2].r);
+			for (i = 0; i < TCP_SACK_HILLS - 1; i++) {
+				b->sack.sack_v.hill[i].l =
+					htonl(tcp_lost.hill[i].l);
+				b->sack.sack_v.hill[i].r =
+					htonl(tcp_lost.hill[i].r);
+			}
 			b->sack.sack_v.hill[3].l = TCP_O_NOP;
 			b->sack.sack_v.hill[3].r = TCP_O_NOP;
 		}
@@ -205,7 +310,7 @@ int net_set_ack_options(union tcp_build_pkt *b)
 }
 
 /**
- * net_set_ack_options() - set TCP options in SYN packets
+ * net_set_syn_options() - set TCP options in SYN packets
  * @b: the packet
  */
 void net_set_syn_options(union tcp_build_pkt *b)
@@ -219,7 +324,7 @@ void net_set_syn_options(union tcp_build_pkt *b)
 	b->ip.mss.len = TCP_OPT_LEN_4;
 	b->ip.mss.mss = htons(TCP_MSS);
 	b->ip.scale.kind = TCP_O_SCL;
-	b->ip.scale.scale = TCP_SCALE;
+	b->ip.scale.scale = tcp_get_wscale();
 	b->ip.scale.len = TCP_OPT_LEN_3;
 	if (IS_ENABLED(CONFIG_PROT_TCP_SACK)) {
 		b->ip.sack_p.kind = TCP_P_SACK;
@@ -318,6 +423,19 @@ int tcp_set_tcp_header(uchar *pkt, int dport, int sport, int payload_len,
 	pkt_len	= pkt_hdr_len + payload_len;
 	tcp_len	= pkt_len - IP_HDR_SIZE;
 
+	/*
+	 * Once connected, data is acknowledged up to the first hole in the
+	 * stream, whatever the caller asks for. Any delayed ACK goes too.
+	 */
+	if ((current_tcp_state == TCP_ESTABLISHED ||
+	     current_tcp_state == TCP_CLOSE_WAIT ||
+	     current_tcp_state == TCP_CLOSING) && !(action & TCP_SYN))
+		tcp_ack_num = tcp_ack_edge;
+	if (b->ip.hdr.tcp_flags & TCP_ACK) {
+		tcp_ack_pending = 0;
+		tcp_ack_now = false;
+	}
+
 	tcp_ack_edge = tcp_ack_num;
 	/* TCP Header */
 	b->ip.hdr.tcp_ack = htonl(tcp_ack_edge);
@@ -327,20 +445,15 @@ int tcp_set_tcp_header(uchar *pkt, int dport, int sport, int payload_len,
 
 	/*
 	 * TCP window size - TCP header variable tcp_win.
-	 * Change tcp_win only if you have an understanding of network
-	 * overrun, congestion, TCP segment sizes, TCP windows, TCP scale,
-	 * queuing theory  and packet buffering. If there are too few buffers,
-	 * there will be data loss, recovery may work or the sending TCP,
-	 * the server, could abort the stream transmission.
-	 * MSS is governed by maximum Ethernet frame length.
-	 * The number of buffers is governed by the desire to have a queue of
-	 * full buffers to be processed at the destination to maximize
-	 * throughput. Temporary memory use for the boot phase on modern
-	 * SOCs is may not be considered a constraint to buffer space, if
-	 * it is, then the u-boot tftp or nfs kernel netboot should be
-	 * considered.
+	 * By default the window is a few full segments, as many as there are
+	 * receive buffers, since the handler may not be able to deal with
+	 * data arriving out of order. Handlers which store data straight at
+	 * its final place in memory, like wget, can ask for a much larger
+	 * window with tcp_set_rcv_window(), so that a fast link stays busy
+	 * during a whole round trip. The window is shifted by the scale sent
+	 * in our SYN, except in SYNs themselves (RFC 7323).
 	 */
-	b->ip.hdr.tcp_win = htons(PKTBUFSRX * TCP_MSS >> TCP_SCALE);
+	b->ip.hdr.tcp_win = htons(tcp_get_window(action & TCP_SYN));
 
 	b->ip.hdr.tcp_xsum = 0;
 	b->ip.hdr.tcp_ugr = 0;
@@ -355,111 +468,97 @@ int tcp_set_tcp_header(uchar *pkt, int dport, int sport, int payload_len,
 }
 
 /**
- * tcp_hole() - Selective Acknowledgment (Essential for fast stream transfer)
- * @tcp_seq_num: TCP sequence start number
- * @len: the length of sequence numbers
+ * tcp_rx_data() - record data received, as a hill or at the left edge
+ * @tcp_seq_num: TCP sequence number of the first byte
+ * @len: number of bytes
+ *
+ * Sets tcp_ack_now when the data is ahead of a hole or fills one, since the
+ * peer needs to hear about it at once (RFC 5681).
+ *
+ * Return: true if the data is new and must be passed to the handler, false if
+ * it was already received or does not fit in the window
  */
-void tcp_hole(u32 tcp_seq_num, u32 len)
+static bool tcp_rx_data(u32 tcp_seq_num, u32 len)
 {
-	u32 idx_sack, sack_in;
-	u32 sack_end = TCP_SACK - 1;
-	u32 hill = 0;
-	enum pkt_state expect = PKT;
-	u32 seq = tcp_seq_num - tcp_seq_init;
-	u32 hol_l = tcp_ack_edge - tcp_seq_init;
-	u32 hol_r = 0;
-
-	/* Place new seq number in correct place in receive array */
-	if (prev_len == 0)
-		prev_len = len;
-
-	idx_sack = sack_idx + ((tcp_seq_num - tcp_ack_edge) / prev_len);
-	if (idx_sack < TCP_SACK) {
-		edge_a[idx_sack].se.l = tcp_seq_num;
-		edge_a[idx_sack].se.r = tcp_seq_num + len;
-		edge_a[idx_sack].st = PKT;
+	u32 l = tcp_seq_num;
+	u32 r = tcp_seq_num + len;
+	int i;
 
-		/*
-		 * The fin (last) packet is not the same length as data
-		 * packets, and if it's length is recorded and used for
-		 *  array index calculation, calculation breaks.
-		 */
-		if (prev_len < len)
-			prev_len = len;
+	if (!tcp_seq_after(r, tcp_ack_edge)) {
+		debug_cond(DEBUG_DEV_PKT, "TCP dup seq %u, len %u\n",
+			   l - tcp_seq_init, len);
+		return false;
+	}
+	if (!tcp_seq_before(l, tcp_ack_edge + tcp_rcv_wnd)) {
+		debug_cond(DEBUG_DEV_PKT, "TCP seq %u out of window\n",
+			   l - tcp_seq_init);
+		return false;
 	}
 
-	debug_cond(DEBUG_DEV_PKT,
-		   "TCP 1 seq %d, edg %d, len %d, sack_idx %d, sack_end %d\n",
-		    seq, hol_l, len, sack_idx, sack_end);
-
-	/* Right edge of contiguous stream, is the left edge of first hill */
-	hol_l = tcp_seq_num - tcp_seq_init;
-	hol_r = hol_l + len;
+	/* Data at the left edge moves it, over any hills it now touches */
+	if (!tcp_seq_after(l, tcp_ack_edge)) {
+		tcp_ack_edge = r;
+		tcp_hill_last = -1;
+		for (i = 0; i < tcp_hill_count; i++) {
+			if (tcp_seq_after(tcp_hills[i].l, tcp_ack_edge))
+				break;
+			if (tcp_seq_after(tcp_hills[i].r, tcp_ack_edge))
+				tcp_ack_edge = tcp_hills[i].r;
+		}
+		if (i) {
+			tcp_hill_count -= i;
+			memmove(tcp_hills, tcp_hills + i,
+				tcp_hill_count * sizeof(*tcp_hills));
+			tcp_ack_now = true;
+		}
 
-	if (IS_ENABLED(CONFIG_PROT_TCP_SACK))
-		tcp_lost.len = TCP_OPT_LEN_2;
+		return true;
+	}
 
-	debug_cond(DEBUG_DEV_PKT,
-		   "TCP 1 in %d, seq %d, pkt_l %d, pkt_r %d, sack_idx %d, sack_end %d\n",
-		   idx_sack, seq, hol_l, hol_r, sack_idx, sack_end);
-
-	for (sack_in = sack_idx; sack_in < sack_end && hill < TCP_SACK_HILLS;
-	     sack_in++)  {
-		switch (expect) {
-		case NOPKT:
-			switch (edge_a[sack_in].st) {
-			case NOPKT:
-				debug_cond(DEBUG_INT_STATE, "N");
-				break;
-			case PKT:
-				debug_cond(DEBUG_INT_STATE, "n");
-				if (IS_ENABLED(CONFIG_PROT_TCP_SACK)) {
-					tcp_lost.hill[hill].l =
-						edge_a[sack_in].se.l;
-					tcp_lost.hill[hill].r =
-						edge_a[sack_in].se.r;
-				}
-				expect = PKT;
-				break;
-			}
-			break;
-		case PKT:
-			switch (edge_a[sack_in].st) {
-			case NOPKT:
-				debug_cond(DEBUG_INT_STATE, "p");
-				if (sack_in > sack_idx &&
-				    hill < TCP_SACK_HILLS) {
-					hill++;
-					if (IS_ENABLED(CONFIG_PROT_TCP_SACK))
-						tcp_lost.len += TCP_OPT_LEN_8;
-				}
-				expect = NOPKT;
-				break;
-			case PKT:
-				debug_cond(DEBUG_INT_STATE, "P");
-
-				if (tcp_ack_edge == edge_a[sack_in].se.l) {
-					tcp_ack_edge = edge_a[sack_in].se.r;
-					edge_a[sack_in].st = NOPKT;
-					sack_idx++;
-				} else {
-					if (IS_ENABLED(CONFIG_PROT_TCP_SACK) &&
-					    hill < TCP_SACK_HILLS)
-						tcp_lost.hill[hill].r =
-							edge_a[sack_in].se.r;
-				if (IS_ENABLED(CONFIG_PROT_TCP_SACK) &&
-				    sack_in == sack_end - 1)
-					tcp_lost.hill[hill].r =
-						edge_a[sack_in].se.r;
-				}
-				break;
-			}
+	/* Otherwise it goes in a hill, past a hole */
+	tcp_ack_now = true;
+	for (i = 0; i < tcp_hill_count; i++) {
+		if (!tcp_seq_before(tcp_hills[i].r, l))
 			break;
+	}
+	if (i < tcp_hill_count && !tcp_seq_after(tcp_hills[i].l, r)) {
+		if (!tcp_seq_before(l, tcp_hills[i].l) &&
+		    !tcp_seq_after(r, tcp_hills[i].r)) {
+			tcp_hill_last = i;
+			return false;
 		}
+		if (tcp_seq_before(l, tcp_hills[i].l))
+			tcp_hills[i].l = l;
+		if (tcp_seq_after(r, tcp_hills[i].r))
+			tcp_hills[i].r = r;
+
+		/* Merge the following hills which now touch this one */
+		while (i + 1 < tcp_hill_count &&
+		       !tcp_seq_after(tcp_hills[i + 1].l, tcp_hills[i].r)) {
+			if (tcp_seq_after(tcp_hills[i + 1].r, tcp_hills[i].r))
+				tcp_hills[i].r = tcp_hills[i + 1].r;
+			tcp_hill_count--;
+			memmove(tcp_hills + i + 1, tcp_hills + i + 2,
+				(tcp_hill_count - i - 1) * sizeof(*tcp_hills));
+		}
+	} else {
+		if (tcp_hill_count == TCP_SACK) {
+			debug_cond(DEBUG_DEV_PKT, "TCP no room for seq %u\n",
+				   l - tcp_seq_init);
+			return false;
+		}
+		memmove(tcp_hills + i + 1, tcp_hills + i,
+			(tcp_hill_count - i) * sizeof(*tcp_hills));
+		tcp_hills[i].l = l;
+		tcp_hills[i].r = r;
+		tcp_hill_count++;
 	}
-	debug_cond(DEBUG_INT_STATE, "\n");
-	if (!IS_ENABLED(CONFIG_PROT_TCP_SACK) || tcp_lost.len <= TCP_OPT_LEN_2)
-		sack_idx = 0;
+	tcp_hill_last = i;
+	debug_cond(DEBUG_DEV_PKT, "TCP seq %u, len %u ahead of %u, %d hills\n",
+		   l - tcp_seq_init, len, tcp_ack_edge - tcp_seq_init,
+		   tcp_hill_count);
+
+	return true;
 }
 
 /**
@@ -470,37 +569,48 @@ void tcp_hole(u32 tcp_seq_num, u32 len)
 void tcp_parse_options(uchar *o, int o_len)
 {
 	struct tcp_t_opt  *tsopt;
+	uchar *end = o + o_len;
 	uchar *p = o;
 
 	/*
-	 * NOPs are options with a zero length, and thus are special.
+	 * NOPs are options with a single byte, and thus are special.
 	 * All other options have length fields.
 	 */
-	for (p = o; p < (o + o_len); p = p + p[1]) {
-		if (!p[1])
-			return; /* Finished processing options */
+	while (p < end) {
+		if (p[0] == TCP_O_END)
+			return;
+		if (p[0] == TCP_1_NOP) {
+			p++;
+			continue;
+		}
+		if (p + 1 >= end || p[1] < TCP_OPT_LEN_2 || p + p[1] > end)
+			return; /* Malformed option */
 
 		switch (p[0]) {
-		case TCP_O_END:
-			return;
-		case TCP_O_MSS:
 		case TCP_O_SCL:
+			tcp_opt_wscale = true;
+			break;
 		case TCP_P_SACK:
-		case TCP_V_SACK:
+			tcp_opt_sack_ok = true;
 			break;
 		case TCP_O_TS:
 			tsopt = (struct tcp_t_opt *)p;
 			rmt_timestamp = tsopt->t_snd;
-			return;
+			break;
 		}
-
-		/* Process optional NOPs */
-		if (p[0] == TCP_O_NOP)
-			p++;
+		p += p[1];
 	}
 }
 
-static u8 tcp_state_machine(u8 tcp_flags, u32 tcp_seq_num, int payload_len)
+/**
+ * tcp_state_machine() - update the connection state for a received packet
+ * @tcp_flags: TCP flags of the packet
+ * @tcp_seq_num: TCP sequence number of the packet
+ * @payload_len: length of the data, set to 0 if it is not to be passed on
+ *
+ * Return: action for the handler, or of the packet to send back
+ */
+static u8 tcp_state_machine(u8 tcp_flags, u32 tcp_seq_num, int *payload_len)
 {
 	u8 tcp_fin = tcp_flags & TCP_FIN;
 	u8 tcp_syn = tcp_flags & TCP_SYN;
@@ -508,7 +618,6 @@ static u8 tcp_state_machine(u8 tcp_flags, u32 tcp_seq_num, int payload_len)
 	u8 tcp_push = tcp_flags & TCP_PUSH;
 	u8 tcp_ack = tcp_flags & TCP_ACK;
 	u8 action = TCP_DATA;
-	int i;
 
 	/*
 	 * tcp_flags are examined to determine TX action in a given state
@@ -550,14 +659,26 @@ static u8 tcp_state_machine(u8 tcp_flags, u32 tcp_seq_num, int payload_len)
 		} else if (tcp_ack || (tcp_syn && tcp_ack)) {
 			action |= TCP_ACK;
 			tcp_seq_init = tcp_seq_num;
-			tcp_ack_edge = tcp_seq_num + 1;
-			sack_idx = 0;
-			edge_a[sack_idx].se.l = tcp_ack_edge;
-			edge_a[sack_idx].se.r = tcp_ack_edge;
-			prev_len = 0;
+			/* A SYN takes up one sequence number */
+			tcp_ack_edge = tcp_seq_num + (tcp_syn ? 1 : 0);
+			tcp_hill_count = 0;
+			tcp_hill_last = -1;
+			tcp_fin_seen = false;
+			tcp_ack_pending = 0;
+			tcp_ack_now = false;
+
+			/* Options count only if both SYNs carry them */
+			tcp_rcv_wscale = 0;
+			tcp_sack_ok = false;
+			if (tcp_syn && current_tcp_state == TCP_SYN_SENT) {
+				if (tcp_opt_wscale)
+					tcp_rcv_wscale = tcp_get_wscale();
+				tcp_sack_ok = IS_ENABLED(CONFIG_PROT_TCP_SACK) &&
+					      tcp_opt_sack_ok;
+			}
 			current_tcp_state = TCP_ESTABLISHED;
-			for (i = 0; i < TCP_SACK; i++)
-				edge_a[i].st = NOPKT;
+			if (*payload_len > 0)
+				tcp_rx_data(tcp_ack_edge, *payload_len);
 
 			if (tcp_syn && tcp_ack)
 				action |= TCP_PUSH;
@@ -567,18 +688,23 @@ static u8 tcp_state_machine(u8 tcp_flags, u32 tcp_seq_num, int payload_len)
 		break;
 	case TCP_ESTABLISHED:
 		debug_cond(DEBUG_INT_STATE, "TCP_ESTABLISHED %x\n", tcp_flags);
-		if (payload_len > 0) {
-			tcp_hole(tcp_seq_num, payload_len);
-			tcp_fin = TCP_DATA;  /* cause standalone FIN */
+		if (tcp_fin) {
+			tcp_fin_seen = true;
+			tcp_fin_seq = tcp_seq_num + *payload_len;
+		}
+		if (*payload_len > 0 &&
+		    !tcp_rx_data(tcp_seq_num, *payload_len)) {
+			/* Nothing new: just tell the peer what we have */
+			*payload_len = 0;
+			action = TCP_ACK;
+			tcp_push = 0;
 		}
 
-		if ((tcp_fin) &&
-		    (!IS_ENABLED(CONFIG_PROT_TCP_SACK) ||
-		     tcp_lost.len <= TCP_OPT_LEN_2)) {
+		/* The FIN only counts once all the data before it is in */
+		if (tcp_fin_seen && tcp_ack_edge == tcp_fin_seq) {
+			tcp_ack_edge++;
 			action = action | TCP_FIN | TCP_PUSH | TCP_ACK;
 			current_tcp_state = TCP_CLOSE_WAIT;
-		} else if (tcp_ack) {
-			action = TCP_DATA;
 		}
 
 		if (tcp_syn)
@@ -673,6 +799,8 @@ void rxhand_tcp_f(union tcp_build_pkt *b, unsigned int pkt_len)
 	tcp_hdr_len = GET_TCP_HDR_LEN_IN_BYTES(b->ip.hdr.tcp_hlen);
 	payload_len = tcp_len - tcp_hdr_len;
 
+	tcp_opt_wscale = false;
+	tcp_opt_sack_ok = false;
 	if (tcp_hdr_len > TCP_HDR_SIZE)
 		tcp_parse_options((uchar *)b + IP_TCP_HDR_SIZE,
 				  tcp_hdr_len - TCP_HDR_SIZE);
@@ -683,9 +811,17 @@ void rxhand_tcp_f(union tcp_build_pkt *b, unsigned int pkt_len)
 	tcp_seq_num = ntohl(b->ip.hdr.tcp_seq);
 	tcp_ack_num = ntohl(b->ip.hdr.tcp_ack);
 
-	/* Packets are not ordered. Send to app as received. */
+	/* Where to send a delayed ACK */
+	tcp_ack_dport = ntohs(b->ip.hdr.tcp_src);
+	tcp_ack_sport = ntohs(b->ip.hdr.tcp_dst);
+	tcp_ack_seq = tcp_ack_num;
+
+	/*
+	 * Packets are not ordered. New data is sent to app as received, at
+	 * any place in the window.
+	 */
 	tcp_action = tcp_state_machine(b->ip.hdr.tcp_flags,
-				       tcp_seq_num, payload_len);
+				       tcp_seq_num, &payload_len);
 
 	tcp_activity_count++;
 	if (tcp_activity_count > TCP_ACTIVITY) {
@@ -717,3 +853,35 @@ void rxhand_tcp_f(union tcp_build_pkt *b, unsigned int pkt_len)
 				    tcp_ack_num, tcp_ack_edge);
 	}
 }
+
+static void tcp_send_ack(void)
+{
+	net_send_tcp_packet(0, tcp_ack_dport, tcp_ack_sport, TCP_ACK,
+			    tcp_ack_seq, tcp_ack_edge);
+}
+
+/**
+ * tcp_ack_data() - acknowledge the data passed to the handler
+ *
+ * The ACK may be held back until more data is received, see
+ * tcp_flush_ack().
+ */
+void tcp_ack_data(void)
+{
+	if (current_tcp_state != TCP_ESTABLISHED)
+		return;
+
+	if (++tcp_ack_pending >= TCP_ACK_SEGMENTS || tcp_ack_now)
+		tcp_send_ack();
+}
+
+/**
+ * tcp_flush_ack() - send any delayed ACK
+ *
+ * This is called by the network loop once no more packets are waiting.
+ */
+void tcp_flush_ack(void)
+{
+	if (tcp_ack_pending && current_tcp_state == TCP_ESTABLISHED)
+		tcp_send_ack();
+}
@@ -17,6 +17,7 @@
 #include <net.h>
 #include <net6.h>
 #include <asm/global_data.h>
+#include <linux/bitmap.h>
 #include <net/tftp.h>
 #include "bootp.h"
 
@@ -26,6 +27,8 @@ DECLARE_GLOBAL_DATA_PTR;
 #define WELL_KNOWN_PORT	69
 /* Millisecs to timeout for lost pkt */
 #define TIMEOUT		5000UL
+/* Millisecs to wait for late blocks before asking for them again */
+#define REORDER_TIMEOUT	20UL
 /* Number of "loading" hashes per line (for checking the image size) */
 #define HASHES_PER_LINE	65
 
@@ -98,6 +101,44 @@ static ushort	tftp_windowsize;
 static ushort	tftp_next_ack;
 /* Last nack block we send */
 static ushort	tftp_last_nack;
+/* Number of blocks acked at a time, reduced on loss, up to tftp_windowsize */
+static ushort	tftp_cur_window;
+/* A block was lost since the last ack */
+static bool	tftp_window_lost;
+/* Blocks stored ahead of tftp_cur_block, indexed by absolute block number */
+static DECLARE_BITMAP(tftp_reorder_map, CONFIG_TFTP_REORDER_BLOCKS);
+/* Number of bits set in tftp_reorder_map */
+static int	tftp_reorder_count;
+/* Absolute number of the furthest block stored ahead */
+static ulong	tftp_reorder_last;
+/* Absolute number of the last block of the file, if stored ahead, else 0 */
+static ulong	tftp_final_block;
+
+/* Number of window sizes recorded in the statistics */
+#define TFTP_WINDOW_HIST	16
+
+/**
+ * struct tftp_stats - statistics for a transfer
+ *
+ * @blocks: Number of blocks stored
+ * @reordered: Number of blocks stored ahead of a missing block
+ * @dups: Number of blocks received more than once
+ * @lost: Number of times we asked for missing blocks again
+ * @timeouts: Number of timeouts
+ * @window_hist: First window sizes used
+ * @window_changes: Number of times the window size changed
+ */
+struct tftp_stats {
+	ulong blocks;
+	ulong reordered;
+	ulong dups;
+	ulong lost;
+	ulong timeouts;
+	ushort window_hist[TFTP_WINDOW_HIST];
+	int window_changes;
+};
+
+static struct tftp_stats tftp_stats;
 #ifdef CONFIG_CMD_TFTPPUT
 /* 1 if writing, else 0 */
 static int	tftp_put_active;
@@ -180,16 +221,38 @@ static inline int store_block(int block, uchar *src, unsigned int len)
 
 	if (net_boot_file_size < newsize)
 		net_boot_file_size = newsize;
+	tftp_stats.blocks++;
 
 	return 0;
 }
 
+/* Get the absolute number of the current block, counting wraparounds */
+static ulong tftp_abs_block(void)
+{
+	return tftp_block_wrap * TFTP_SEQUENCE_SIZE + tftp_cur_block;
+}
+
+/* Set the number of blocks acked at a time, recording it for the stats */
+static void tftp_set_window(ushort window)
+{
+	if (window == tftp_cur_window)
+		return;
+	tftp_cur_window = window;
+	if (tftp_stats.window_changes < TFTP_WINDOW_HIST)
+		tftp_stats.window_hist[tftp_stats.window_changes] = window;
+	tftp_stats.window_changes++;
+}
+
 /* Clear our state ready for a new transfer */
 static void new_transfer(void)
 {
 	tftp_prev_block = 0;
 	tftp_block_wrap = 0;
 	tftp_block_wrap_offset = 0;
+	bitmap_zero(tftp_reorder_map, CONFIG_TFTP_REORDER_BLOCKS);
+	tftp_reorder_count = 0;
+	tftp_reorder_last = 0;
+	tftp_final_block = 0;
 #ifdef CONFIG_CMD_TFTPPUT
 	tftp_put_final_block_sent = 0;
 #endif
@@ -283,6 +346,136 @@ static void update_block_number(void)
 	show_block_marker();
 }
 
+/*
+ * Ask the server to send the window again from the block after the current
+ * one, since a block is missing
+ */
+static void tftp_nack(void)
+{
+	/*
+	 * If one packet is dropped most likely
+	 * all other buffers in the window
+	 * that will arrive will cause a sending NACK.
+	 * This just overwellms the server, let's just send one.
+	 */
+	if (tftp_last_nack == tftp_cur_block)
+		return;
+
+	tftp_send();
+	tftp_last_nack = tftp_cur_block;
+	tftp_stats.lost++;
+
+	/* Ack more often while blocks are being lost */
+	tftp_window_lost = true;
+	tftp_set_window(max(tftp_cur_window / 2, 1));
+	tftp_next_ack = (ushort)(tftp_cur_block + tftp_cur_window);
+}
+
+static void tftp_reorder_timeout_handler(void)
+{
+	net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
+	tftp_nack();
+}
+
+/* Check if the last block of the window was received, ahead of a gap */
+static bool tftp_window_end_seen(void)
+{
+	ulong end = tftp_abs_block() + (ushort)(tftp_next_ack - tftp_cur_block);
+
+	return tftp_final_block || tftp_reorder_last >= end;
+}
+
+/*
+ * Handle a data block which is not the one expected next. A block which is
+ * a little ahead is stored at its place straight away, so that only the
+ * missing blocks need to be received again.
+ */
+static void tftp_data_ahead(ushort block, uchar *src, unsigned int len)
+{
+	ushort ahead = block - (ushort)(tftp_cur_block + 1);
+	ulong abs;
+	int bit;
+
+	/*
+	 * Don't ACK blocks older than the expected one, since the server is
+	 * just retransmitting the window
+	 */
+	if (ahead >= TFTP_SEQUENCE_SIZE / 2) {
+		tftp_stats.dups++;
+		return;
+	}
+	if (tftp_state != STATE_DATA || ahead >= CONFIG_TFTP_REORDER_BLOCKS) {
+		tftp_nack();
+		return;
+	}
+
+	abs = tftp_abs_block() + 1 + ahead;
+	bit = abs % CONFIG_TFTP_REORDER_BLOCKS;
+	if (test_bit(bit, tftp_reorder_map)) {
+		tftp_stats.dups++;
+		return;
+	}
+	if (store_block(tftp_cur_block + 1 + ahead, src, len)) {
+		eth_halt();
+		net_set_state(NETLOOP_FAIL);
+		return;
+	}
+	__set_bit(bit, tftp_reorder_map);
+	tftp_reorder_count++;
+	tftp_stats.reordered++;
+	if (len < tftp_block_size)
+		tftp_final_block = abs;
+	tftp_reorder_last = max(tftp_reorder_last, abs);
+
+	/*
+	 * The end of the window came in with blocks missing. Give blocks which
+	 * are merely late a moment to arrive, then ask for them again.
+	 */
+	if (tftp_window_end_seen())
+		net_set_timeout_handler(REORDER_TIMEOUT,
+					tftp_reorder_timeout_handler);
+}
+
+/*
+ * Move past the blocks stored ahead which now follow on from the current one
+ *
+ * Return: true if the last block of the file was reached
+ */
+static bool tftp_reorder_drain(void)
+{
+	int bit;
+
+	while (tftp_reorder_count) {
+		bit = (tftp_abs_block() + 1) % CONFIG_TFTP_REORDER_BLOCKS;
+		if (!test_bit(bit, tftp_reorder_map))
+			break;
+		__clear_bit(bit, tftp_reorder_map);
+		tftp_reorder_count--;
+
+		tftp_cur_block = (tftp_cur_block + 1) % TFTP_SEQUENCE_SIZE;
+		update_block_number();
+		tftp_prev_block = tftp_cur_block;
+		if (tftp_abs_block() == tftp_final_block)
+			return true;
+	}
+
+	return false;
+}
+
+static void tftp_show_stats(void)
+{
+	struct tftp_stats *st = &tftp_stats;
+	int i;
+
+	printf("\n\t %lu blocks, %lu out of order, %lu duplicate",
+	       st->blocks, st->reordered, st->dups);
+	printf("\n\t %lu lost, %lu timeouts, window", st->lost, st->timeouts);
+	for (i = 0; i < min(st->window_changes, TFTP_WINDOW_HIST); i++)
+		printf(" %d", st->window_hist[i]);
+	if (st->window_changes > TFTP_WINDOW_HIST)
+		printf(" ... %d", tftp_cur_window);
+}
+
 /* The TFTP get or put is complete */
 static void tftp_complete(void)
 {
@@ -301,6 +494,8 @@ static void tftp_complete(void)
 		print_size(net_boot_file_size /
 			time_start * 1000, "/s");
 	}
+	if (IS_ENABLED(CONFIG_TFTP_STATS) && !tftp_put_active)
+		tftp_show_stats();
 	puts("\ndone\n");
 	if (IS_ENABLED(CONFIG_CMD_BOOTEFI)) {
 		if (!tftp_put_active)
@@ -572,7 +767,8 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			}
 		}
 
-		tftp_next_ack = tftp_windowsize;
+		tftp_set_window(tftp_windowsize);
+		tftp_next_ack = tftp_cur_window;
 
 #ifdef CONFIG_CMD_TFTPPUT
 		if (tftp_put_active && tftp_state == STATE_OACK) {
@@ -592,26 +788,7 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			debug("Received unexpected block: %d, expected: %d\n",
 			      ntohs(*(__be16 *)pkt),
 			      (ushort)(tftp_cur_block + 1));
-			/*
-			 * Only ACK if the block count received is greater than
-			 * the expected block count, otherwise skip ACK.
-			 * (required to properly handle the server retransmitting
-			 *  the window)
-			 */
-			if ((ushort)(tftp_cur_block + 1) - (short)(ntohs(*(__be16 *)pkt)) > 0)
-				break;
-			/*
-			 * If one packet is dropped most likely
-			 * all other buffers in the window
-			 * that will arrive will cause a sending NACK.
-			 * This just overwellms the server, let's just send one.
-			 */
-			if (tftp_last_nack != tftp_cur_block) {
-				tftp_send();
-				tftp_last_nack = tftp_cur_block;
-				tftp_next_ack = (ushort)(tftp_cur_block +
-							 tftp_windowsize);
-			}
+			tftp_data_ahead(ntohs(*(__be16 *)pkt), pkt + 2, len);
 			break;
 		}
 
@@ -620,7 +797,8 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 		if (tftp_state == STATE_SEND_RRQ) {
 			debug("Server did not acknowledge any options!\n");
-			tftp_next_ack = tftp_windowsize;
+			tftp_set_window(tftp_windowsize);
+			tftp_next_ack = tftp_cur_window;
 		}
 
 		if (tftp_state == STATE_SEND_RRQ || tftp_state == STATE_OACK ||
@@ -656,7 +834,7 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			break;
 		}
 
-		if (len < tftp_block_size) {
+		if (len < tftp_block_size || tftp_reorder_drain()) {
 			tftp_send();
 			tftp_complete();
 			break;
@@ -664,11 +842,19 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 		/*
 		 *	Acknowledge the block just received, which will prompt
-		 *	the remote for the next one.
+		 *	the remote for the next one. Blocks stored ahead may
+		 *	have taken us past the end of the window.
 		 */
-		if (tftp_cur_block == tftp_next_ack) {
+		if ((short)((ushort)tftp_cur_block - tftp_next_ack) >= 0) {
 			tftp_send();
-			tftp_next_ack += tftp_windowsize;
+			if (!tftp_window_lost && tftp_cur_window < tftp_windowsize)
+				tftp_set_window(tftp_cur_window + 1);
+			tftp_window_lost = false;
+			tftp_next_ack = (ushort)(tftp_cur_block +
+						 tftp_cur_window);
+		} else if (tftp_reorder_count && tftp_window_end_seen()) {
+			net_set_timeout_handler(REORDER_TIMEOUT,
+						tftp_reorder_timeout_handler);
 		}
 		break;
 
@@ -705,6 +891,13 @@ static void tftp_timeout_handler(void)
 	} else {
 		puts("T ");
 		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
+		if (tftp_state == STATE_DATA && !tftp_put_active) {
+			/* Start again from a single block at a time */
+			tftp_stats.timeouts++;
+			tftp_window_lost = true;
+			tftp_set_window(1);
+			tftp_next_ack = (ushort)(tftp_cur_block + 1);
+		}
 		if (tftp_state != STATE_RECV_WRQ)
 			tftp_send();
 	}
@@ -946,6 +1139,9 @@ void tftp_start(enum proto_t protocol)
 	tftp_cur_block = 0;
 	tftp_windowsize = 1;
 	tftp_last_nack = 0;
+	tftp_cur_window = 0;
+	tftp_window_lost = false;
+	memset(&tftp_stats, '\0', sizeof(tftp_stats));
 	/* zero out server ether in case the server ip has changed */
 	memset(net_server_ethaddr, 0, 6);
 	/* Revert tftp_block_size to dflt */
@@ -986,6 +1182,10 @@ void tftp_start_server(void)
 	tftp_our_port = WELL_KNOWN_PORT;
 	tftp_windowsize = 1;
 	tftp_next_ack = tftp_windowsize;
+	tftp_cur_window = 0;
+	tftp_window_lost = false;
+	memset(&tftp_stats, '\0', sizeof(tftp_stats));
+	tftp_set_window(tftp_windowsize);
 
 #ifdef CONFIG_TFTP_TSIZE
 	tftp_tsize = 0;
@@ -24,23 +24,14 @@ static struct in_addr web_server_ip;
 static int our_port;
 static int wget_timeout_count;
 
-struct pkt_qd {
-	uchar *pkt;
-	unsigned int tcp_seq_num;
-	unsigned int len;
-};
-
-/*
- * This is a control structure for out of order packets received.
- * The actual packet bufers are in the kernel space, and are
- * expected to be overwritten by the downloaded image.
- */
-#define PKTQ_SZ (PKTBUFSRX / 4)
-static struct pkt_qd pkt_q[PKTQ_SZ];
-static int pkt_q_idx;
 static unsigned long content_length;
 static unsigned int packets;
+static ulong time_start;
 
+/*
+ * Sequence number of the first byte of the file. Until the HTTP header is
+ * received, this is the start of the header instead.
+ */
 static unsigned int initial_data_seq_num;
 
 static enum  wget_state current_wget_state;
@@ -102,7 +93,6 @@ static void wget_send_stored(void)
 		packets = 0;
 		break;
 	case WGET_CONNECTING:
-		pkt_q_idx = 0;
 		net_send_tcp_packet(0, SERVER_PORT, our_port, action,
 				    tcp_seq_num, tcp_ack_num);
 
@@ -131,14 +121,19 @@ static void wget_send_stored(void)
 	}
 }
 
-static void wget_send(u8 action, unsigned int tcp_seq_num,
-		      unsigned int tcp_ack_num, int len)
+static void wget_set_retry(u8 action, unsigned int tcp_seq_num,
+			   unsigned int tcp_ack_num, int len)
 {
 	retry_action = action;
 	retry_tcp_ack_num = tcp_ack_num;
 	retry_tcp_seq_num = tcp_seq_num;
 	retry_len = len;
+}
 
+static void wget_send(u8 action, unsigned int tcp_seq_num,
+		      unsigned int tcp_ack_num, int len)
+{
+	wget_set_retry(action, tcp_seq_num, tcp_ack_num, len);
 	wget_send_stored();
 }
 
@@ -175,13 +170,10 @@ static void wget_timeout_handler(void)
 	}
 }
 
-#define PKT_QUEUE_OFFSET 0x20000
-#define PKT_QUEUE_PACKET_SIZE 0x800
-
 static void wget_connected(uchar *pkt, unsigned int tcp_seq_num,
 			   u8 action, unsigned int tcp_ack_num, unsigned int len)
 {
-	uchar *pkt_in_q;
+	unsigned int ahead;
 	char *pos;
 	int hlen, i;
 	uchar *ptr1;
@@ -189,27 +181,16 @@ static void wget_connected(uchar *pkt, unsigned int tcp_seq_num,
 	pkt[len] = '\0';
 	pos = strstr((char *)pkt, http_eom);
 
-	if (!pos) {
+	if (tcp_seq_num != initial_data_seq_num || !pos) {
+		/*
+		 * Data received ahead of the header is stored as if the header
+		 * were part of the file, then moved down once the header is in
+		 */
 		debug_cond(DEBUG_WGET,
 			   "wget: Connected, data before Header %p\n", pkt);
-		pkt_in_q = (void *)image_load_addr + PKT_QUEUE_OFFSET +
-			(pkt_q_idx * PKT_QUEUE_PACKET_SIZE);
-
-		ptr1 = map_sysmem((phys_addr_t)pkt_in_q, len);
-		memcpy(ptr1, pkt, len);
-		unmap_sysmem(ptr1);
-
-		pkt_q[pkt_q_idx].pkt = pkt_in_q;
-		pkt_q[pkt_q_idx].tcp_seq_num = tcp_seq_num;
-		pkt_q[pkt_q_idx].len = len;
-		pkt_q_idx++;
-
-		if (pkt_q_idx >= PKTQ_SZ) {
-			printf("wget: Fatal error, queue overrun!\n");
-			net_set_state(NETLOOP_FAIL);
-
-			return;
-		}
+		if ((int)(tcp_seq_num - initial_data_seq_num) >= 0)
+			store_block(pkt, tcp_seq_num - initial_data_seq_num,
+				    len);
 	} else {
 		debug_cond(DEBUG_WGET, "wget: Connected HTTP Header %p\n", pkt);
 		/* sizeof(http_eom) - 1 is the string length of (http_eom) */
@@ -246,7 +227,18 @@ static void wget_connected(uchar *pkt, unsigned int tcp_seq_num,
 					   content_length);
 			}
 
-			net_boot_file_size = 0;
+			ahead = 0;
+			if (net_boot_file_size > len)
+				ahead = net_boot_file_size - len;
+			if (ahead) {
+				ptr1 = map_sysmem(image_load_addr, len + ahead);
+				memmove(ptr1 + len - hlen, ptr1 + len, ahead);
+				unmap_sysmem(ptr1);
+				debug_cond(DEBUG_WGET,
+					   "wget: Connctd moved %x bytes\n",
+					   ahead);
+			}
+			net_boot_file_size = ahead ? len - hlen + ahead : 0;
 
 			if (len > hlen)
 				store_block(pkt + hlen, 0, len - hlen);
@@ -254,20 +246,6 @@ static void wget_connected(uchar *pkt, unsigned int tcp_seq_num,
 			debug_cond(DEBUG_WGET,
 				   "wget: Connected Pkt %p hlen %x\n",
 				   pkt, hlen);
-
-			for (i = 0; i < pkt_q_idx; i++) {
-				ptr1 = map_sysmem(
-					(phys_addr_t)(pkt_q[i].pkt),
-					pkt_q[i].len);
-				store_block(ptr1,
-					    pkt_q[i].tcp_seq_num -
-					    initial_data_seq_num,
-					    pkt_q[i].len);
-				unmap_sysmem(ptr1);
-				debug_cond(DEBUG_WGET,
-					   "wget: Connctd pkt Q %p len %x\n",
-					   pkt_q[i].pkt, pkt_q[i].len);
-			}
 		}
 	}
 	wget_send(action, tcp_seq_num, tcp_ack_num, len);
@@ -309,6 +287,8 @@ static void wget_handler(uchar *pkt, u16 dport,
 			if (wget_tcp_state == TCP_ESTABLISHED) {
 				debug_cond(DEBUG_WGET,
 					   "wget: Cting, send, len=%x\n", len);
+				initial_data_seq_num = tcp_seq_num + 1;
+				net_boot_file_size = 0;
 				wget_send(action, tcp_seq_num, tcp_ack_num,
 					  len);
 			} else {
@@ -333,7 +313,7 @@ static void wget_handler(uchar *pkt, u16 dport,
 			   "wget: Transferring, seq=%x, ack=%x,len=%x\n",
 			   tcp_seq_num, tcp_ack_num, len);
 
-		if (tcp_seq_num >= initial_data_seq_num &&
+		if ((int)(tcp_seq_num - initial_data_seq_num) >= 0 &&
 		    store_block(pkt, tcp_seq_num - initial_data_seq_num,
 				len) != 0) {
 			wget_fail("wget: store error\n",
@@ -353,8 +333,9 @@ static void wget_handler(uchar *pkt, u16 dport,
 			net_set_state(NETLOOP_FAIL);
 			break;
 		case TCP_ESTABLISHED:
-			wget_send(TCP_ACK, tcp_seq_num, tcp_ack_num,
-				  len);
+			/* The TCP stack may hold the ACK back for a while */
+			wget_set_retry(TCP_ACK, tcp_seq_num, tcp_ack_num, len);
+			tcp_ack_data();
 			wget_loop_state = NETLOOP_SUCCESS;
 			break;
 		case TCP_CLOSE_WAIT:     /* End of transfer */
@@ -366,6 +347,12 @@ static void wget_handler(uchar *pkt, u16 dport,
 		break;
 	case WGET_TRANSFERRED:
 		printf("Packets received %d, Transfer Successful\n", packets);
+		time_start = get_timer(time_start);
+		if (time_start > 0) {
+			puts("Rate ");
+			print_size(net_boot_file_size / time_start * 1000,
+				   "/s\n");
+		}
 		net_set_state(wget_loop_state);
 		break;
 	}
@@ -431,6 +418,10 @@ void wget_start(void)
 	net_set_timeout_handler(wget_timeout, wget_timeout_handler);
 	tcp_set_tcp_handler(wget_handler);
 
+	/* Data is stored at its final place as soon as it arrives */
+	tcp_set_rcv_window(CONFIG_PROT_TCP_WINDOW);
+	time_start = get_timer(0);
+
 	wget_timeout_count = 0;
 	current_wget_state = WGET_CLOSED;
 
@@ -0,0 +1,220 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Test for TFTP windows with lost and reordered blocks, using a fake server
+ * behind the sandbox ethernet driver
+ */
+
+#include <common.h>
+#include <command.h>
+#include <console.h>
+#include <dm.h>
+#include <env.h>
+#include <mapmem.h>
+#include <net.h>
+#include <asm/eth.h>
+#include <test/lib.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define TFTP_RRQ	1
+#define TFTP_DATA	3
+#define TFTP_ACK	4
+#define TFTP_OACK	6
+
+#define TEST_PORT	1069
+#define TEST_BLOCK_SIZE	512
+/* Leaves room for the packet being processed in the receive queue */
+#define TEST_WINDOW	(PKTBUFSRX - 1)
+#define TEST_BLOCKS	61
+#define TEST_SIZE	((TEST_BLOCKS - 1) * TEST_BLOCK_SIZE + 100)
+
+/* Block sent after the next one, the first time */
+#define TEST_LATE_BLOCK	8
+
+/**
+ * struct sb_tftp - state of the fake TFTP server
+ *
+ * @client_port: UDP port of the client
+ * @sent: true for each block sent at least once
+ * @acks: number of ACKs received
+ * @overflows: number of packets which did not fit in the receive queue
+ */
+struct sb_tftp {
+	int client_port;
+	bool sent[TEST_BLOCKS + 1];
+	int acks;
+	int overflows;
+};
+
+static struct sb_tftp sb_tftp;
+
+static u8 sb_tftp_byte(uint offset)
+{
+	return offset * 7 + (offset >> 9);
+}
+
+/* Blocks lost the first time they are sent */
+static bool sb_tftp_lost(int block)
+{
+	return block == 20 || block == 41;
+}
+
+static int sb_tftp_reply(struct udevice *dev, void *packet, const void *data,
+			 int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = packet;
+	struct ethernet_hdr *eth_recv;
+	struct ip_udp_hdr *ipr;
+
+	/* Don't allow the buffer to overrun */
+	if (priv->recv_packets >= PKTBUFSRX) {
+		sb_tftp.overflows++;
+		return 0;
+	}
+
+	eth_recv = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth_recv->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_recv->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_recv->et_protlen = htons(PROT_IP);
+
+	ipr = (void *)eth_recv + ETHER_HDR_SIZE;
+	memcpy((void *)ipr + IP_UDP_HDR_SIZE, data, len);
+	ipr->udp_src = htons(TEST_PORT);
+	ipr->udp_dst = htons(sb_tftp.client_port);
+	ipr->udp_len = htons(UDP_HDR_SIZE + len);
+	ipr->udp_xsum = 0;
+	net_set_ip_header((uchar *)ipr, net_ip, priv->fake_host_ipaddr,
+			  IP_UDP_HDR_SIZE + len, IPPROTO_UDP);
+
+	priv->recv_packet_length[priv->recv_packets] =
+		ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + len;
+	++priv->recv_packets;
+
+	return 0;
+}
+
+/* Send a window of blocks, starting at @first */
+static int sb_tftp_window(struct udevice *dev, void *packet, int first)
+{
+	uchar buf[4 + TEST_BLOCK_SIZE];
+	int order[TEST_WINDOW];
+	int block, count, len, ret, i, j;
+	bool lost;
+
+	for (count = 0; count < TEST_WINDOW; count++) {
+		if (first + count > TEST_BLOCKS)
+			break;
+		order[count] = first + count;
+	}
+
+	for (i = 0; i + 1 < count; i++) {
+		if (order[i] == TEST_LATE_BLOCK && !sb_tftp.sent[order[i]]) {
+			order[i] = order[i + 1];
+			order[i + 1] = TEST_LATE_BLOCK;
+			break;
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		block = order[i];
+		lost = !sb_tftp.sent[block] && sb_tftp_lost(block);
+		sb_tftp.sent[block] = true;
+		if (lost)
+			continue;
+
+		len = block == TEST_BLOCKS ?
+			TEST_SIZE - (TEST_BLOCKS - 1) * TEST_BLOCK_SIZE :
+			TEST_BLOCK_SIZE;
+		*(__be16 *)buf = htons(TFTP_DATA);
+		*(__be16 *)(buf + 2) = htons(block);
+		for (j = 0; j < len; j++)
+			buf[4 + j] = sb_tftp_byte((block - 1) * TEST_BLOCK_SIZE +
+						  j);
+		ret = sb_tftp_reply(dev, packet, buf, 4 + len);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int sb_tftp_handler(struct udevice *dev, void *packet,
+			   unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	__be16 *s = (void *)ip + IP_UDP_HDR_SIZE;
+	char buf[40];
+	int pos;
+
+	if (ntohs(eth->et_protlen) == PROT_ARP)
+		return sandbox_eth_arp_req_to_reply(dev, packet, len);
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_UDP)
+		return 0;
+
+	/*
+	 * Leave only the packet being processed: the others are lost, since
+	 * the server always starts a new window
+	 */
+	if (priv->recv_packets > 1)
+		priv->recv_packets = 1;
+
+	switch (ntohs(s[0])) {
+	case TFTP_RRQ:
+		sb_tftp.client_port = ntohs(ip->udp_src);
+		*(__be16 *)buf = htons(TFTP_OACK);
+		pos = 2;
+		pos += sprintf(buf + pos, "blksize") + 1;
+		pos += sprintf(buf + pos, "%d", TEST_BLOCK_SIZE) + 1;
+		pos += sprintf(buf + pos, "windowsize") + 1;
+		pos += sprintf(buf + pos, "%d", TEST_WINDOW) + 1;
+		return sb_tftp_reply(dev, packet, buf, pos);
+	case TFTP_ACK:
+		sb_tftp.acks++;
+		return sb_tftp_window(dev, packet, ntohs(s[1]) + 1);
+	}
+
+	return 0;
+}
+
+static int net_test_tftp_window(struct unit_test_state *uts)
+{
+	u8 *buf;
+	int i;
+
+	memset(&sb_tftp, '\0', sizeof(sb_tftp));
+	sandbox_eth_set_tx_handler(0, sb_tftp_handler);
+
+	env_set("ethact", "eth@10002000");
+	env_set("ethrotate", "no");
+	env_set("loadaddr", "0x20000");
+	env_set("tftpwindowsize", "8");
+	ut_assertok(console_record_reset_enable());
+	ut_assertok(run_command("tftpboot ${loadaddr} 1.1.2.2:test.bin", 0));
+	sandbox_eth_set_tx_handler(0, NULL);
+	env_set("tftpwindowsize", NULL);
+
+	ut_asserteq(TEST_SIZE, env_get_hex("filesize", 0));
+	buf = map_sysmem(0x20000, TEST_SIZE);
+	for (i = 0; i < TEST_SIZE; i++) {
+		if (buf[i] != sb_tftp_byte(i))
+			break;
+	}
+	unmap_sysmem(buf);
+	ut_asserteq(TEST_SIZE, i);
+	ut_asserteq(0, sb_tftp.overflows);
+	ut_asserteq(26, sb_tftp.acks);
+
+	/*
+	 * The late block is stored as soon as it arrives. The block following
+	 * each lost one is stored ahead, after which the window shrinks and
+	 * grows back.
+	 */
+	ut_assert_skip_to_line("\t 61 blocks, 3 out of order, 0 duplicate");
+	ut_assert_nextline("\t 2 lost, 0 timeouts, window 3 1 2 3 1 2 3");
+
+	return 0;
+}
+LIB_TEST(net_test_tftp_window, 0);
@@ -334,3 +334,57 @@ static int dm_test_blk_foreach(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_blk_foreach, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+#if CONFIG_IS_ENABLED(BLOCK_CACHE)
+/* Test that the block cache serves hits, partial hits and reads ahead */
+static int dm_test_blk_cache(struct unit_test_state *uts)
+{
+	struct block_cache_stats stats;
+	char write[16 * 512], read[16 * 512];
+	struct blk_desc *desc;
+	int i;
+
+	ut_assertok(blk_get_device_by_str("mmc", "0", &desc));
+	ut_asserteq(512, desc->blksz);
+	for (i = 0; i < sizeof(write); i++)
+		write[i] = i * 7;
+	ut_asserteq(16, blk_dwrite(desc, 0, 16, write));
+	blkcache_configure(0x10000, 16);
+
+	/* A repeated read comes from the cache */
+	ut_asserteq(2, blk_dread(desc, 4, 2, read));
+	ut_asserteq(2, blk_dread(desc, 4, 2, read));
+	ut_asserteq_mem(&write[4 * 512], read, 2 * 512);
+
+	/* A sequential read fetches the following blocks too */
+	ut_asserteq(2, blk_dread(desc, 6, 2, read));
+	ut_asserteq_mem(&write[6 * 512], read, 2 * 512);
+	ut_asserteq(8, blk_dread(desc, 8, 8, read));
+	ut_asserteq_mem(&write[8 * 512], read, 8 * 512);
+
+	blkcache_stats(&stats);
+	ut_asserteq(2, stats.hits);
+	ut_asserteq(2, stats.misses);
+	ut_asserteq(0, stats.partial_hits);
+	ut_asserteq(8, stats.readahead);
+
+	/* Only the missing blocks are read when some are cached */
+	ut_asserteq(4, blk_dread(desc, 14, 4, read));
+	ut_asserteq_mem(&write[14 * 512], read, 2 * 512);
+	blkcache_stats(&stats);
+	ut_asserteq(0, stats.hits);
+	ut_asserteq(0, stats.misses);
+	ut_asserteq(1, stats.partial_hits);
+
+	/* A write drops the cached data */
+	ut_asserteq(16, blk_dwrite(desc, 0, 16, write));
+	blkcache_stats(&stats);
+	ut_asserteq(0, stats.entries);
+
+	blkcache_configure(CONFIG_BLOCK_CACHE_SIZE,
+			   CONFIG_BLOCK_CACHE_READAHEAD);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_cache, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+#endif
@@ -0,0 +1,165 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for the work queue, using host threads as secondary CPUs
+ */
+
+#include <common.h>
+#include <workq.h>
+#include <asm/test.h>
+#include <test/lib.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define TEST_JOBS	16
+#define TEST_CPUS	4
+
+/* Number of loops a job waits for the others, before giving up */
+#define TEST_SPIN	100000000
+
+struct test_job {
+	uint start;	/* first number to add up */
+	ulong sum;	/* result */
+	int cpu;	/* CPU seen by workq_cpu() */
+	int ret;	/* value to return */
+};
+
+static int test_started;
+static int test_wait;
+
+static int test_job_func(struct workq_job *job)
+{
+	struct test_job *tj = job->priv;
+	int i;
+
+	/* Hold on until enough jobs run at once, to use all CPUs */
+	__atomic_fetch_add(&test_started, 1, __ATOMIC_ACQ_REL);
+	for (i = 0; i < TEST_SPIN; i++) {
+		if (__atomic_load_n(&test_started, __ATOMIC_ACQUIRE) >=
+		    test_wait)
+			break;
+	}
+
+	tj->sum = 0;
+	for (i = 0; i < 1000; i++)
+		tj->sum += tj->start + i;
+	tj->cpu = workq_cpu();
+
+	/* schedule() must be harmless on any CPU */
+	schedule();
+
+	return tj->ret;
+}
+
+static void test_setup(struct workq_job *jobs, struct test_job *tjobs,
+		       int wait)
+{
+	int i;
+
+	for (i = 0; i < TEST_JOBS; i++) {
+		tjobs[i].start = i * 1000;
+		tjobs[i].sum = 0;
+		tjobs[i].cpu = -1;
+		tjobs[i].ret = 0;
+		jobs[i].func = test_job_func;
+		jobs[i].priv = &tjobs[i];
+		jobs[i].ret = -EINVAL;
+		jobs[i].cpu = -1;
+	}
+	test_started = 0;
+	test_wait = wait;
+}
+
+static int test_check(struct unit_test_state *uts, struct workq_job *jobs,
+		      struct test_job *tjobs, uint *cpu_mask)
+{
+	int i;
+
+	*cpu_mask = 0;
+	for (i = 0; i < TEST_JOBS; i++) {
+		ut_asserteq(1000 * 1000 * i + 999 * 1000 / 2, tjobs[i].sum);
+		ut_asserteq(jobs[i].cpu, tjobs[i].cpu);
+		ut_assert(jobs[i].cpu >= 0 && jobs[i].cpu < TEST_CPUS);
+		*cpu_mask |= 1 << jobs[i].cpu;
+	}
+
+	return 0;
+}
+
+/* Test running jobs on several CPUs */
+static int lib_test_workq_run(struct unit_test_state *uts)
+{
+	struct test_job tjobs[TEST_JOBS];
+	struct workq_job jobs[TEST_JOBS];
+	uint cpu_mask;
+	int i;
+
+	sandbox_workq_set_cpus(TEST_CPUS);
+	ut_asserteq(TEST_CPUS, workq_get_cpus());
+
+	test_setup(jobs, tjobs, TEST_CPUS);
+	ut_assertok(workq_run(jobs, TEST_JOBS));
+	ut_assertok(test_check(uts, jobs, tjobs, &cpu_mask));
+	for (i = 0; i < TEST_JOBS; i++)
+		ut_assertok(jobs[i].ret);
+
+	/* Every CPU took part, including the boot CPU */
+	ut_asserteq((1 << TEST_CPUS) - 1, cpu_mask);
+
+	/* Outside jobs we are always on the boot CPU */
+	ut_asserteq(0, workq_cpu());
+
+	/* Fewer jobs than CPUs */
+	test_setup(jobs, tjobs, 2);
+	ut_assertok(workq_run(jobs, 2));
+	ut_assert(tjobs[0].sum && tjobs[1].sum);
+	ut_asserteq(0, tjobs[2].sum);
+
+	/* No jobs at all */
+	ut_assertok(workq_run(jobs, 0));
+
+	return 0;
+}
+LIB_TEST(lib_test_workq_run, 0);
+
+/* Test that errors are reported and do not stop the other jobs */
+static int lib_test_workq_error(struct unit_test_state *uts)
+{
+	struct test_job tjobs[TEST_JOBS];
+	struct workq_job jobs[TEST_JOBS];
+	uint cpu_mask;
+
+	sandbox_workq_set_cpus(TEST_CPUS);
+	test_setup(jobs, tjobs, TEST_CPUS);
+	tjobs[5].ret = -EIO;
+	tjobs[9].ret = -ENOENT;
+	ut_asserteq(-EIO, workq_run(jobs, TEST_JOBS));
+	ut_assertok(test_check(uts, jobs, tjobs, &cpu_mask));
+	ut_asserteq(-EIO, jobs[5].ret);
+	ut_asserteq(-ENOENT, jobs[9].ret);
+	ut_assertok(jobs[0].ret);
+
+	return 0;
+}
+LIB_TEST(lib_test_workq_error, 0);
+
+/* Test falling back to the boot CPU alone */
+static int lib_test_workq_single(struct unit_test_state *uts)
+{
+	struct test_job tjobs[TEST_JOBS];
+	struct workq_job jobs[TEST_JOBS];
+	uint cpu_mask;
+
+	sandbox_workq_set_cpus(1);
+	ut_asserteq(1, workq_get_cpus());
+
+	/* No waiting, there is no one else to wait for */
+	test_setup(jobs, tjobs, 0);
+	ut_assertok(workq_run(jobs, TEST_JOBS));
+	ut_assertok(test_check(uts, jobs, tjobs, &cpu_mask));
+	ut_asserteq(1, cpu_mask);
+
+	sandbox_workq_set_cpus(TEST_CPUS);
+
+	return 0;
+}
+LIB_TEST(lib_test_workq_single, 0);
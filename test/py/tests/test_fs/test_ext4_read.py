@@ -0,0 +1,77 @@
+# SPDX-License-Identifier: GPL-2.0+
+#
+# U-Boot File System: ext4 read throughput
+
+"""
+This test reads a large file from an ext4 image through the sandbox host block
+device, checks its contents and logs the throughput reported by the load
+command, so that changes to the ext4 read path can be compared.
+"""
+
+import os
+import re
+import shutil
+import zlib
+import pytest
+import u_boot_utils as util
+
+EXT4_SRC_DIR = 'ext4_read_src'
+EXT4_IMAGE_NAME = 'ext4_read.img'
+EXT4_FILE_NAME = 'image'
+
+# Sizes in MiB
+IMAGE_SIZE = 128
+FILE_SIZE = 60
+
+def make_ext4_image(u_boot_console):
+    """Make the ext4 image used for the test
+
+    Args:
+        u_boot_console (ConsoleBase): U-Boot console
+
+    Returns:
+        tuple: path to the image, CRC32 of the file in it
+    """
+    cons = u_boot_console
+    root = os.path.join(cons.config.persistent_data_dir, EXT4_SRC_DIR)
+    image = os.path.join(cons.config.persistent_data_dir, EXT4_IMAGE_NAME)
+    shutil.rmtree(root, ignore_errors=True)
+    os.makedirs(root)
+
+    data = os.urandom(FILE_SIZE << 20)
+    with open(os.path.join(root, EXT4_FILE_NAME), 'wb') as fd:
+        fd.write(data)
+
+    util.run_and_log(cons, f'rm -f {image}')
+    util.run_and_log(cons, ['mkfs.ext4', '-q', '-O', '^metadata_csum',
+                            '-d', root, image, f'{IMAGE_SIZE}M'])
+    shutil.rmtree(root)
+
+    return image, zlib.crc32(data)
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_ext4')
+@pytest.mark.buildconfigspec('cmd_crc32')
+@pytest.mark.requiredtool('mkfs.ext4')
+@pytest.mark.slow
+def test_ext4_read_speed(u_boot_console):
+    """Read a large file from ext4 and report the throughput"""
+    cons = u_boot_console
+    image, crc = make_ext4_image(cons)
+    addr = util.find_ram_base(cons) + 0x100000
+
+    cons.run_command(f'host bind 0 {image}')
+    try:
+        output = cons.run_command(
+            f'ext4load host 0 {addr:x} {EXT4_FILE_NAME}')
+        match = re.search(r'(\d+) bytes read in (\d+) ms', output)
+        assert match
+        assert int(match.group(1)) == FILE_SIZE << 20
+        msecs = max(int(match.group(2)), 1)
+        cons.log.info(f'ext4 read: {FILE_SIZE * 1000 // msecs} MiB/s')
+
+        output = cons.run_command(f'crc32 {addr:x} $filesize')
+        assert f'==> {crc:08x}' in output
+    finally:
+        cons.run_command('host unbind 0')
+        os.remove(image)
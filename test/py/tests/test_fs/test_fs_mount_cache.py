@@ -0,0 +1,106 @@
+# SPDX-License-Identifier: GPL-2.0+
+#
+# U-Boot File System: mount cache
+
+"""
+This test checks that filesystem operations on the same partition reuse the
+mounted filesystem instead of probing it again, and that writes and rebinding
+the device drop it.
+"""
+
+import os
+import re
+import shutil
+import pytest
+import u_boot_utils as util
+
+SRC_DIR = 'fs_mount_cache_src'
+IMAGE_NAME = 'fs_mount_cache.img'
+
+def make_image(u_boot_console):
+    """Make an ext4 image holding two small files
+
+    Args:
+        u_boot_console (ConsoleBase): U-Boot console
+
+    Returns:
+        str: path to the image
+    """
+    cons = u_boot_console
+    root = os.path.join(cons.config.persistent_data_dir, SRC_DIR)
+    image = os.path.join(cons.config.persistent_data_dir, IMAGE_NAME)
+    shutil.rmtree(root, ignore_errors=True)
+    os.makedirs(root)
+    for name in ['one', 'two']:
+        with open(os.path.join(root, name), 'w') as fd:
+            fd.write(name * 100)
+
+    util.run_and_log(cons, f'rm -f {image}')
+    util.run_and_log(cons, ['mkfs.ext4', '-q', '-O', '^metadata_csum',
+                            '-d', root, image, '8M'])
+    shutil.rmtree(root)
+
+    return image
+
+def get_stats(u_boot_console):
+    """Get the mount cache information
+
+    Returns:
+        tuple: mounted filesystem (str), probes (int), probes saved (int)
+    """
+    output = u_boot_console.run_command('fscache show')
+    mounted = re.search('mounted: (.*)', output).group(1).strip()
+    probes = int(re.search(r'probes: (\d+)', output).group(1))
+    saved = int(re.search(r'probes saved: (\d+)', output).group(1))
+
+    return mounted, probes, saved
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('fs_mount_cache')
+@pytest.mark.buildconfigspec('cmd_ext4_write')
+@pytest.mark.requiredtool('mkfs.ext4')
+def test_fs_mount_cache(u_boot_console):
+    """Test that the mounted filesystem is reused and dropped as needed"""
+    cons = u_boot_console
+    image = make_image(cons)
+    addr = util.find_ram_base(cons) + 0x100000
+
+    cons.run_command(f'host bind 0 {image}')
+    try:
+        cons.run_command('fscache flush')
+        _, probes, saved = get_stats(cons)
+
+        output = cons.run_command('size host 0 one')
+        assert 'Failed' not in output
+        mounted, new_probes, new_saved = get_stats(cons)
+        assert mounted == 'host 0:0 (ext4)'
+        assert new_probes > probes
+        probes = new_probes
+
+        # Further reads do not probe again
+        cons.run_command(f'load host 0 {addr:x} two')
+        cons.run_command('ls host 0')
+        _, new_probes, new_saved = get_stats(cons)
+        assert new_probes == probes
+        assert new_saved == saved + 2
+        saved = new_saved
+
+        # A write closes the filesystem
+        output = cons.run_command(f'save host 0 {addr:x} three 10')
+        assert '10 bytes written' in output
+        mounted, _, saved = get_stats(cons)
+        assert mounted == 'none'
+
+        # Rebinding the device closes it too
+        cons.run_command('size host 0 three')
+        cons.run_command('host unbind 0')
+        cons.run_command(f'host bind 0 {image}')
+        mounted, _, _ = get_stats(cons)
+        assert mounted == 'none'
+        output = cons.run_command('size host 0 three')
+        assert 'Failed' not in output
+        _, _, new_saved = get_stats(cons)
+        assert new_saved == saved
+    finally:
+        cons.run_command('host unbind 0')
+        os.remove(image)